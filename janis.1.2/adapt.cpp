@@ -0,0 +1,272 @@
+/************************************************************************/
+/*  Author: Daniel Janis                                                */
+/*  Date: 9/22/2020                                                     */
+/*  Purpose:                                                            */
+/*  The [-a] mode of proc_fan: instead of a fixed [-n #], how many      */
+/*  commands run at once is changed every ADAPT_TICK_MS from what the   */
+/*  last interval measured:                                             */
+/*   - commands finished per second. The count keeps moving the same   */
+/*     way while that goes up, and turns around when the last move     */
+/*     made it go down (hill climbing). Until the first time it turns  */
+/*     around it doubles each tick, so a machine that can take         */
+/*     hundreds gets there in a few seconds. It doesn't go up again    */
+/*     until a command has finished since the last change: before that */
+/*     the rate can't tell whether more helped.                         */
+/*   - Linux pressure stall information (/proc/pressure/cpu and         */
+/*     /proc/pressure/memory): the share of the interval some task was */
+/*     waiting for a CPU or for memory. With the CPUs full, more         */
+/*     commands only wait in line, so the count goes down unless that   */
+/*     still helped; waiting for memory cuts it by a quarter.           */
+/*   - how many more processes can be started: the pids.max of our     */
+/*     cgroup, the kernel's task limits, and RLIMIT_NPROC. The count   */
+/*     stays PID_RESERVE below the first one to run out, so proc_fan    */
+/*     backs off before a spawn fails with EAGAIN instead of after.    */
+/*  Without PSI (kernels before 4.20, or turned off) only the first    */
+/*  and the last are used.                                              */
+/************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <string>
+#include "adapt.h"
+
+struct AdaptSample adapt_sample = {0, -1, -1, LONG_MAX};
+
+// /proc/pressure files, -1 if there are none
+int cpu_psi_fd = -1, memory_psi_fd = -1;
+long long last_cpu_us, last_memory_us;
+
+// pids.max and pids.current of our cgroup, empty if there is no pids controller
+std::string pids_max_path, pids_current_path;
+
+// Most tasks the kernel allows (threads-max and pid_max), and RLIMIT_NPROC (-1 for none)
+long task_limit = LONG_MAX;
+long nproc_limit = -1;
+
+// The last tick
+long long last_ns;
+long last_completed = 0;
+double last_rate = 0;
+int direction = 1; // +1 while adding commands, -1 while taking them away
+bool slow_start = true; // Doubling, until the first move down
+long moved_completed = 0; // Commands finished when the count last changed
+
+// Reads a whole (small) file into buf, returns false if it can't
+bool read_file(const char* path, char* buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    ssize_t length = read(fd, buf, size - 1);
+    close(fd);
+    if (length <= 0)
+        return false;
+    buf[length] = '\0';
+    return true;
+}
+
+// The first number in a file, "max" counts as LONG_MAX, -1 if it can't be read
+long read_number(const char* path) {
+    char buf[64];
+    if (!read_file(path, buf, sizeof(buf)))
+        return -1;
+    if (strncmp(buf, "max", 3) == 0)
+        return LONG_MAX;
+    return atol(buf);
+}
+
+// Microseconds some task has waited, from the "some ... total=" line of a pressure file
+long long psi_total(int fd) {
+    char buf[256];
+    ssize_t length = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (length <= 0)
+        return -1;
+    buf[length] = '\0';
+    char* total = strstr(buf, "total=");
+    return (total == NULL) ? -1 : atoll(total + 6);
+}
+
+// Share of the last "seconds" some task waited on the resource of "fd", -1 if unknown
+double stall(int fd, long long* last_us, double seconds) {
+    if (fd == -1)
+        return -1;
+    long long total = psi_total(fd);
+    if (total == -1)
+        return -1;
+    double share = (total - *last_us) / (seconds * 1e6);
+    *last_us = total;
+    return share;
+}
+
+// Finds our cgroup's pids.max and pids.current, cgroup v1 ("N:pids:/path") or v2 ("0::/path")
+void find_pids_cgroup() {
+    FILE* file = fopen("/proc/self/cgroup", "re");
+    if (file == NULL)
+        return;
+    char line[4096];
+    std::string v1, v2;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char* path = strchr(line, ':');
+        if (path == NULL || (path = strchr(path + 1, ':')) == NULL)
+            continue;
+        if (strstr(line, ":pids:") != NULL)
+            v1 = std::string("/sys/fs/cgroup/pids") + (path + 1);
+        else if (strncmp(line, "0::", 3) == 0)
+            v2 = std::string("/sys/fs/cgroup") + (path + 1);
+    }
+    fclose(file);
+    const std::string* tries[2] = {&v1, &v2};
+    for (int t = 0; t < 2; t++) {
+        if (tries[t]->empty())
+            continue;
+        std::string max = *tries[t] + "/pids.max";
+        if (access(max.c_str(), R_OK) == 0) {
+            pids_max_path = max;
+            pids_current_path = *tries[t] + "/pids.current";
+            return;
+        }
+    }
+}
+
+// Tasks (threads) of our real user, RLIMIT_NPROC counts these
+long user_tasks() {
+    DIR* proc = opendir("/proc");
+    if (proc == NULL)
+        return -1;
+    char wanted[32];
+    snprintf(wanted, sizeof(wanted), "Uid:\t%u\t", (unsigned) getuid());
+    long tasks = 0;
+    struct dirent* entry;
+    while ((entry = readdir(proc)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+        char path[sizeof("/proc//status") + NAME_MAX], status[4096]; // Room for any d_name
+        snprintf(path, sizeof(path), "/proc/%s/status", entry->d_name);
+        if (!read_file(path, status, sizeof(status)) || strstr(status, wanted) == NULL)
+            continue;
+        char* threads = strstr(status, "Threads:");
+        tasks += (threads == NULL) ? 1 : atol(threads + 8);
+    }
+    closedir(proc);
+    return tasks;
+}
+
+// How many more processes can be started before one of the limits is hit
+long headroom() {
+    long room = LONG_MAX;
+    if (!pids_max_path.empty()) {
+        long max = read_number(pids_max_path.c_str());
+        long current = read_number(pids_current_path.c_str());
+        if (max != LONG_MAX && max >= 0 && current >= 0)
+            room = max - current;
+    }
+    char loadavg[128];
+    long tasks = -1; // Every task on the system, "running/total" in /proc/loadavg
+    if (read_file("/proc/loadavg", loadavg, sizeof(loadavg))) {
+        char* slash = strchr(loadavg, '/');
+        if (slash != NULL)
+            tasks = atol(slash + 1);
+    }
+    if (tasks >= 0 && task_limit != LONG_MAX && task_limit - tasks < room)
+        room = task_limit - tasks;
+    // Ours are at most all of them: only count them (a walk over /proc) when that could matter
+    if (nproc_limit != -1 && tasks >= 0 && nproc_limit - tasks < room) {
+        long mine = user_tasks();
+        if (mine >= 0 && nproc_limit - mine < room)
+            room = nproc_limit - mine;
+    }
+    return room;
+}
+
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Finds everything the ticks look at, call once before the first
+void adapt_init() {
+    cpu_psi_fd = open("/proc/pressure/cpu", O_RDONLY | O_CLOEXEC);
+    memory_psi_fd = open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC);
+    if (cpu_psi_fd != -1 && (last_cpu_us = psi_total(cpu_psi_fd)) == -1) { // Compiled in, turned off
+        close(cpu_psi_fd);
+        cpu_psi_fd = -1;
+    }
+    if (memory_psi_fd != -1 && (last_memory_us = psi_total(memory_psi_fd)) == -1) {
+        close(memory_psi_fd);
+        memory_psi_fd = -1;
+    }
+    find_pids_cgroup();
+    long threads_max = read_number("/proc/sys/kernel/threads-max");
+    long pid_max = read_number("/proc/sys/kernel/pid_max");
+    if (threads_max > 0)
+        task_limit = threads_max;
+    if (pid_max > 0 && pid_max < task_limit)
+        task_limit = pid_max;
+    struct rlimit nproc;
+    if (getrlimit(RLIMIT_NPROC, &nproc) == 0 && nproc.rlim_cur != RLIM_INFINITY && getuid() != 0)
+        nproc_limit = nproc.rlim_cur; // root isn't held to it
+    last_ns = monotonic_ns();
+}
+
+// One tick: returns how many commands should run from now on (between 1 and "ceiling"), given
+// how many should have run so far ("target"), how many run now, how many have finished in all,
+// and whether there were always more lines waiting ("busy"; if not, the throughput says
+// nothing about the count).
+long adapt_tick(long target, long ceiling, long running, long completed, bool busy) {
+    long long now = monotonic_ns();
+    double seconds = (now - last_ns) / 1e9;
+    if (seconds <= 0)
+        return target;
+    double rate = (completed - last_completed) / seconds;
+    double cpu = stall(cpu_psi_fd, &last_cpu_us, seconds);
+    double memory = stall(memory_psi_fd, &last_memory_us, seconds);
+    long room = headroom();
+
+    long next = target;
+    long step = (target / 8 > 1) ? target / 8 : 1;
+    if (memory > MEMORY_PRESSURE) {
+        next = target - target / 4 - 1;
+        direction = -1;
+    }
+    else if (room < PID_RESERVE) { // Give back what is missing as the running ones exit
+        next = running - (PID_RESERVE - room);
+        direction = -1;
+    }
+    else if (busy) {
+        if (rate < last_rate * 0.95) // The last move made it worse
+            direction = -direction;
+        else if (cpu > CPU_PRESSURE && rate <= last_rate * 1.05) // CPUs are full and more didn't help
+            direction = -1;
+        if (direction < 0)
+            slow_start = false;
+        if (direction > 0 && completed == moved_completed) // Long commands, nothing to judge the last move by yet
+            next = target;
+        else
+            next = target + direction * (slow_start ? target : step);
+        if (direction > 0 && room != LONG_MAX && next > running + room - PID_RESERVE)
+            next = running + room - PID_RESERVE;
+    }
+    if (next > ceiling)
+        next = ceiling;
+    if (next < 1)
+        next = 1;
+
+    if (next != target)
+        moved_completed = completed;
+    last_ns = now;
+    last_completed = completed;
+    last_rate = rate;
+    adapt_sample.rate = rate;
+    adapt_sample.cpu = cpu;
+    adapt_sample.memory = memory;
+    adapt_sample.headroom = room;
+    return next;
+}
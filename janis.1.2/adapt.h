@@ -0,0 +1,25 @@
+/* Author: Daniel Janis */
+/* Date: 9/22/2020      */
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#define ADAPT_TICK_MS 500 // How often [-a] looks at the system and changes how many commands run
+#define ADAPT_CEILING 1024 // Most commands at once with [-a] and no [-n #]
+#define CPU_PRESSURE 0.5 // Share of the time something waited for a CPU that means the CPUs are full
+#define MEMORY_PRESSURE 0.1 // Share of the time something waited for memory that means back off
+#define PID_RESERVE 32 // Processes left free for everyone else, and for the commands' own children
+
+// What the last [-a] tick measured, for [-v]
+struct AdaptSample {
+    double rate; // Commands finished per second
+    double cpu; // Share of the time some task waited for a CPU, -1 without PSI
+    double memory; // Share of the time some task waited for memory, -1 without PSI
+    long headroom; // Processes that can still be started before one would fail, LONG_MAX if unknown
+};
+
+extern struct AdaptSample adapt_sample;
+
+void adapt_init();
+long adapt_tick(long, long, long, long, bool);
+
+#endif
@@ -0,0 +1,213 @@
+/************************************************************************/
+/*  Author: Daniel Janis                                                */
+/*  Date: 9/22/2020                                                     */
+/*  Purpose:                                                            */
+/*  Output capture for proc_fan's [-k] mode: every command's stdout and */
+/*  stderr go to pipes of their own, and what comes out is printed in   */
+/*  the order of the input lines, never mixed with another command's.  */
+/*  The first line that hasn't finished printing is "printing": its    */
+/*  output is moved straight to our stdout/stderr with splice(), the   */
+/*  kernel moves the pages and they never pass through proc_fan. The    */
+/*  lines after it are held until it is done, the first SPILL_LIMIT     */
+/*  bytes of each stream in memory and the rest spliced into an         */
+/*  unlinked temporary file, so a command with a lot of output doesn't  */
+/*  fill our memory. When a line is done (its command exited and both  */
+/*  pipes are at end of file) the next one prints what it held (stdout */
+/*  first, then stderr) and goes on printing live.                      */
+/*                                                                      */
+/*  splice() needs a file or pipe on the other end: for a terminal, or */
+/*  a file opened with O_APPEND, the output is copied with read() and   */
+/*  write() instead.                                                    */
+/************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include "capture.h"
+
+std::deque<struct Record*> order;
+
+// Where each stream of the commands ends up
+const int out_fd[2] = {STDOUT_FILENO, STDERR_FILENO};
+
+// Cleared for an output that won't take splice()
+bool splice_out[2] = {true, true};
+
+// Writes all of "buf" to "fd"
+void write_all(int fd, const char* buf, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, buf, length);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return; // Nowhere left to put it, like a closed pipe
+        }
+        buf += written;
+        length -= written;
+    }
+}
+
+// Adds a record for input line "line" to the end of the order
+struct Record* record_new(long line) {
+    struct Record* record = new Record;
+    record->line = line;
+    record->exited = false;
+    record->printing = false;
+    for (int s = 0; s < 2; s++) {
+        record->stream[s].pipe_fd = -1;
+        record->stream[s].spill_fd = -1;
+    }
+    order.push_back(record);
+    return record;
+}
+
+// Makes the two pipes of "record" and has the child's stdout and stderr go into them.
+// write_end[] gets the ends the child writes to, close them once it is spawned. Returns 0, or
+// the error.
+int capture_pipes(struct Record* record, posix_spawn_file_actions_t* actions, int* write_end) {
+    for (int s = 0; s < 2; s++) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) { // dup2() in the child clears O_CLOEXEC on 1 and 2
+            int error = errno;
+            if (s == 1) {
+                close(write_end[0]);
+                capture_close(record, 0);
+            }
+            return error;
+        }
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        record->stream[s].pipe_fd = fds[0];
+        write_end[s] = fds[1];
+        posix_spawn_file_actions_adddup2(actions, fds[1], out_fd[s]);
+    }
+    return 0;
+}
+
+// An unlinked file in $TMPDIR (or /tmp) to spill into, -1 if none can be made
+int spill_open() {
+    const char* dir = getenv("TMPDIR");
+    if (dir == NULL || dir[0] == '\0')
+        dir = "/tmp";
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1) { // File system without O_TMPFILE
+        std::string path = std::string(dir) + "/proc_fan.XXXXXX";
+        fd = mkostemp(&path[0], O_CLOEXEC);
+        if (fd != -1)
+            unlink(path.c_str());
+    }
+    return fd;
+}
+
+// Moves what is in the pipe "from" to output stream s. Returns what read() would.
+ssize_t move_out(int from, int s) {
+    if (splice_out[s]) {
+        ssize_t moved = splice(from, NULL, out_fd[s], NULL, CAPTURE_CHUNK, SPLICE_F_MOVE);
+        if (moved != -1 || errno != EINVAL)
+            return moved;
+        splice_out[s] = false;
+    }
+    char buf[CAPTURE_CHUNK];
+    ssize_t length = read(from, buf, sizeof(buf));
+    if (length > 0)
+        write_all(out_fd[s], buf, length);
+    return length;
+}
+
+// Takes what is waiting in pipe s of "record", epoll said it is readable. Returns true at end
+// of file (or an error), the caller closes it then.
+bool capture_read(struct Record* record, int s) {
+    struct Capture* capture = &record->stream[s];
+    ssize_t length;
+    if (record->printing)
+        length = move_out(capture->pipe_fd, s);
+    else {
+        if (capture->spill_fd == -1 && capture->held.size() >= SPILL_LIMIT)
+            capture->spill_fd = spill_open(); // Stays in memory if that fails
+        bool spliced = false;
+        if (capture->spill_fd != -1) {
+            length = splice(capture->pipe_fd, NULL, capture->spill_fd, NULL, CAPTURE_CHUNK, SPLICE_F_MOVE);
+            spliced = (length != -1 || errno != EINVAL);
+        }
+        if (!spliced) {
+            char buf[CAPTURE_CHUNK];
+            length = read(capture->pipe_fd, buf, sizeof(buf));
+            if (length > 0) {
+                if (capture->spill_fd != -1)
+                    write_all(capture->spill_fd, buf, length);
+                else
+                    capture->held.append(buf, length);
+            }
+        }
+    }
+    if (length == -1)
+        return errno != EAGAIN && errno != EINTR;
+    return length == 0;
+}
+
+// Closes pipe s of "record", take it out of the epoll first
+void capture_close(struct Record* record, int s) {
+    if (record->stream[s].pipe_fd != -1) {
+        close(record->stream[s].pipe_fd);
+        record->stream[s].pipe_fd = -1;
+    }
+}
+
+// Adds one of proc_fan's own messages about "record" to its stderr, after what it wrote so far
+void capture_note(struct Record* record, const char* message) {
+    struct Capture* capture = &record->stream[1];
+    size_t length = strlen(message);
+    if (record->printing)
+        write_all(STDERR_FILENO, message, length);
+    else if (capture->spill_fd != -1)
+        write_all(capture->spill_fd, message, length);
+    else
+        capture->held.append(message, length);
+}
+
+// Prints everything one stream held, and lets go of it
+void print_held(struct Capture* capture, int s) {
+    write_all(out_fd[s], capture->held.data(), capture->held.size());
+    std::string().swap(capture->held);
+    if (capture->spill_fd == -1)
+        return;
+    off_t size = lseek(capture->spill_fd, 0, SEEK_CUR);
+    off_t offset = 0;
+    while (offset < size) {
+        ssize_t sent = sendfile(out_fd[s], capture->spill_fd, &offset, size - offset);
+        if (sent > 0)
+            continue;
+        if (sent == -1 && errno == EINTR)
+            continue;
+        if (sent == 0)
+            break;
+        char buf[CAPTURE_CHUNK]; // An output sendfile() can't write to
+        ssize_t length = pread(capture->spill_fd, buf, sizeof(buf), offset);
+        if (length <= 0)
+            break;
+        write_all(out_fd[s], buf, length);
+        offset += length;
+    }
+    close(capture->spill_fd);
+    capture->spill_fd = -1;
+}
+
+// Prints the lines at the front of the order that can be: the front one prints what it held,
+// and if it is done the next one follows
+void capture_flush() {
+    while (!order.empty()) {
+        struct Record* record = order.front();
+        if (!record->printing) {
+            record->printing = true;
+            for (int s = 0; s < 2; s++)
+                print_held(&record->stream[s], s);
+        }
+        if (!record->exited || record->stream[0].pipe_fd != -1 || record->stream[1].pipe_fd != -1)
+            return;
+        order.pop_front();
+        delete record;
+    }
+}
@@ -0,0 +1,38 @@
+/* Author: Daniel Janis */
+/* Date: 9/22/2020      */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <spawn.h>
+#include <string>
+#include <deque>
+
+#define SPILL_LIMIT 65536 // Output of one stream kept in memory, the rest goes to a temporary file
+#define CAPTURE_CHUNK 65536 // Most moved from a pipe at once
+
+// One output stream (stdout or stderr) of a command in [-k] mode
+struct Capture {
+    int pipe_fd; // Our end of the command's pipe, -1 once it is at end of file
+    std::string held; // Output that can't be printed yet
+    int spill_fd; // Unlinked temporary file with the output after the first SPILL_LIMIT bytes, or -1
+};
+
+// One input line in [-k] mode, printed once every line before it has been
+struct Record {
+    long line;
+    bool exited; // The command has been reaped (or never started)
+    bool printing; // Every line before this one is printed, its output goes straight out
+    struct Capture stream[2]; // stdout and stderr
+};
+
+// Records in input order, the front one is printing
+extern std::deque<struct Record*> order;
+
+struct Record* record_new(long);
+int capture_pipes(struct Record*, posix_spawn_file_actions_t*, int*);
+bool capture_read(struct Record*, int);
+void capture_close(struct Record*, int);
+void capture_note(struct Record*, const char*);
+void capture_flush();
+
+#endif
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Author: Daniel Janis
+# Date: 9/22/2020
+# Checks that [-a] backs off under CPU pressure with commands that run longer than a tick:
+# every command spins a CPU for 3 seconds, so nothing finishes for the first few ticks and
+# the throughput stays flat. proc_fan may not go past 4 commands per CPU before [-s time]
+# stops it, slow start used to keep doubling toward ADAPT_CEILING here. Run "make check".
+
+cpus=$(getconf _NPROCESSORS_ONLN)
+most=$((cpus * 4))
+lines=$((cpus * 50))
+summary=$(yes "timeout 3 sh -c 'while :; do :; done'" | head -n "$lines" | ./proc_fan -a -v -s 10 2>&1 | grep "\[-a\] ran")
+highest=$(echo "$summary" | sed -n 's/.*between [0-9]* and \([0-9]*\) of.*/\1/p')
+if [ -z "$highest" ]; then
+    echo "check_adapt: Error: no [-a] summary from proc_fan"
+    exit 1
+fi
+if [ "$highest" -gt "$most" ]; then
+    echo "check_adapt: FAIL: [-a] went up to $highest commands on $cpus CPU(s), at most $most expected"
+    exit 1
+fi
+echo "check_adapt: ok, [-a] stayed at $highest or fewer commands on $cpus CPU(s)"
@@ -0,0 +1,679 @@
+/************************************************************************/
+/*  Author: Daniel Janis                                                */
+/*  Date: 9/22/2020                                                     */
+/*  Purpose:                                                            */
+/*  "proc_fan" reads command lines from standard input and runs each   */
+/*  one as its own process, keeping exactly [-n #] of them running at   */
+/*  once: as soon as one exits the next line is started. Children are  */
+/*  started with posix_spawnp(), which (glibc) shares our memory with   */
+/*  the child until it has called exec instead of copying the page     */
+/*  tables like fork() does, so starting thousands of short commands   */
+/*  doesn't cost a copy of proc_fan each time. Lines are split into    */
+/*  arguments in place in the line buffer, nothing is copied.           */
+/*                                                                      */
+/*  There is no fixed limit on [-n #] any more. If the system runs out  */
+/*  of processes (EAGAIN, the "resource unavailable" error from the     */
+/*  README) the command waits until one of ours exits and is started   */
+/*  then, instead of failing.                                           */
+/*                                                                      */
+/*  Everything proc_fan waits for is a file descriptor in one epoll:   */
+/*  a pidfd for every child (readable once it has exited), a signalfd  */
+/*  for SIGINT and SIGALRM ([-s time]), and a timerfd for the [-t time] */
+/*  timeouts. Whatever exits is reaped as soon as epoll_wait() returns */
+/*  and its slot is filled again before the next wait, so one slow      */
+/*  command never holds up the others. Commands all get the same       */
+/*  timeout, so their deadlines come due in the order they started and */
+/*  one queue with one timer covers all of them.                        */
+/*                                                                      */
+/*  With [-k] the output of every command is captured and printed in   */
+/*  the order of the input lines (capture.cpp), the pipes are in the    */
+/*  same epoll.                                                         */
+/*                                                                      */
+/*  With [-a] the number running is changed every ADAPT_TICK_MS from    */
+/*  throughput and system pressure (adapt.cpp), up to [-n #].           */
+/************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <deque>
+#include "proc_fan.h"
+#include "capture.h"
+#include "adapt.h"
+
+extern char** environ;
+
+// Name proc_fan was called by, for error messages
+std::string exe_name;
+
+// Most commands running at once [-n #]
+long pr_limit = 0;
+
+// How many to keep running: [-n #], or with [-a] what adapt_tick() last said
+long target = 0;
+bool adaptive = false;
+
+// How long one command may run before it gets SIGTERM [-t time], 0 for no limit
+long long timeout_ns = 0;
+
+// Commands that ignore SIGTERM get SIGKILL this long after it
+const long long KILL_GRACE_NS = 2000000000LL;
+
+// Print a summary at the end [-v]
+bool verbose = false;
+
+// Print every command's output in input order [-k]
+bool keep_order = false;
+
+// One running command
+struct Job {
+    pid_t pid; // 0 if the slot is free
+    int pidfd; // -1 if pidfd_open() failed, SIGCHLD tells us about it then
+    long line; // Line of standard input it came from
+    long long start_ns;
+    struct Record* record; // Its output with [-k], NULL without
+};
+
+// Slot of every command that may be running, and the free ones. A slot is only added when
+// every one so far is busy, so there are never more than the most [-a] ever ran at once.
+std::vector<struct Job> jobs;
+std::vector<int> free_slots;
+long running = 0;
+
+// When a command gets its signal, for the [-t time] timeout. Deadlines are added in the order
+// they come due, so each queue stays sorted without any work.
+struct Deadline {
+    long long at_ns;
+    int slot;
+    pid_t pid; // The slot may hold another command by then
+};
+std::deque<struct Deadline> term_queue, kill_queue;
+
+// File descriptors of the event loop, tune_fd ticks for [-a]
+int epoll_fd, signal_fd, timer_fd, tune_fd = -1;
+long long timer_armed_ns = 0; // What timer_fd is set to, 0 if not set
+
+// The signals signal_fd reads, SIGCHLD is added once a pidfd can't be had
+sigset_t signals;
+bool watch_sigchld = false;
+
+// Set by SIGINT or SIGALRM: no more commands are started and the running ones are terminated
+bool stopping = false;
+
+// Commands that couldn't be started or didn't exit with 0
+long failures = 0;
+
+// For [-v]: commands started, and the time they ran all together
+long started = 0;
+long long busy_ns = 0;
+
+// For [-v]: "target" added up over time (commands asked for * nanoseconds), up to target_ns_at
+double target_ns = 0;
+long long target_ns_at = 0;
+
+// epoll tags of the signalfd and the timerfd, pidfds are tagged with their slot and [-k] pipes
+// with TAG_PIPE, their record's address and the stream (0 stdout, 1 stderr)
+#define TAG_SIGNAL (~0UL)
+#define TAG_TIMER (~1UL)
+#define TAG_TUNE (~2UL)
+#define TAG_PIPE (1UL << 62)
+
+int main(int argc, char *argv[]) {
+    // Removes the ./ from the command-line invokation
+    exe_name = argv[0];
+    if (exe_name.find("/") != std::string::npos)
+        exe_name = exe_name.substr(exe_name.find_last_of("/") + 1);
+
+    int run_limit = 0; // [-s time]
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:akvh")) != -1) {
+        switch (opt) {
+            case 'n':
+                pr_limit = atol(optarg);
+                if (pr_limit <= 0)
+                    errors(exe_name, "[-n #] value should be positive and nonzero");
+                break;
+            case 't': // Seconds one command may run, fractions allowed
+                timeout_ns = (long long) (atof(optarg) * 1e9);
+                if (timeout_ns <= 0)
+                    errors(exe_name, "[-t time] value should be positive and nonzero");
+                break;
+            case 's': // Seconds proc_fan may run
+                run_limit = atoi(optarg);
+                if (run_limit <= 0)
+                    errors(exe_name, "[-s time] value should be positive and nonzero");
+                break;
+            case 'a':
+                adaptive = true;
+                break;
+            case 'k':
+                keep_order = true;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 'h':
+            default:
+                usage(exe_name);
+        }
+    }
+    if (pr_limit == 0 && adaptive)
+        pr_limit = ADAPT_CEILING;
+    if (pr_limit == 0)
+        errors(exe_name, "[-n #] is required");
+    if (optind < argc)
+        errors(exe_name, "Too many arguments were used, commands are read from standard input");
+
+    setup_events();
+    if (run_limit > 0)
+        start_clock(run_limit);
+    target = pr_limit;
+    long lowest = 0, highest = 0; // Range [-a] went through, for [-v]
+    if (adaptive) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        target = (cpus > 0 && cpus < pr_limit) ? cpus : pr_limit; // Start with one per CPU
+        lowest = highest = target;
+        adapt_init();
+        tune_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec tick;
+        tick.it_value.tv_sec = tick.it_interval.tv_sec = ADAPT_TICK_MS / 1000;
+        tick.it_value.tv_nsec = tick.it_interval.tv_nsec = ADAPT_TICK_MS % 1000 * 1000000L;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = TAG_TUNE;
+        if (tune_fd == -1 || timerfd_settime(tune_fd, 0, &tick, NULL) == -1 ||
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tune_fd, &event) == -1) {
+            perror("proc_fan: Cannot set up the [-a] timer");
+            exit(EXIT_FAILURE);
+        }
+    }
+    long long begin_ns = target_ns_at = now_ns();
+
+    char* line = NULL; // getline()'s buffer, reused for every line
+    size_t capacity = 0;
+    std::vector<char*> args; // Pointers into "line", one per argument, then NULL
+    long line_number = 0;
+    bool pending = false; // "args" holds a command that is waiting for a free process
+    bool done = false; // Standard input is at its end
+    struct Record* record = NULL; // Output of the line being started with [-k]
+    struct epoll_event events[64];
+    while (true) {
+        // Start commands until [-n #] are running
+        while (running < target && !stopping && (pending || !done)) {
+            if (!pending) {
+                if (getline(&line, &capacity, stdin) == -1) {
+                    done = true;
+                    break;
+                }
+                line_number++;
+                int count = split_args(line, args);
+                if (count == 0) // Blank line
+                    continue;
+                record = keep_order ? record_new(line_number) : NULL;
+                if (count < 0) {
+                    note(record, "%s: Error: line %ld: unterminated quote\n", exe_name.c_str(), line_number);
+                    failures++;
+                    if (record != NULL)
+                        record->exited = true;
+                    continue;
+                }
+            }
+            int error = start_job(args.data(), line_number, record);
+            if (error == EAGAIN && running > 0) { // Out of processes, retry after the next exit
+                pending = true;
+                if (adaptive) // Missed it coming, don't go back above this for now
+                    set_target(running);
+                break;
+            }
+            pending = false;
+            if (error != 0) {
+                note(record, "%s: Error: line %ld: cannot execute \"%s\": %s\n", exe_name.c_str(),
+                     line_number, args[0], strerror(error));
+                failures++;
+                if (record != NULL)
+                    record->exited = true;
+            }
+        }
+        if (stopping && pending) { // Never started now, with [-k] the order has to get past it
+            note(record, "%s: line %ld was not started, stopping\n", exe_name.c_str(), line_number);
+            if (record != NULL)
+                record->exited = true;
+            pending = false;
+        }
+        if (keep_order)
+            capture_flush();
+        if (running == 0 && order.empty())
+            break;
+
+        arm_timer();
+        int count = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("proc_fan: epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+        for (int e = 0; e < count; e++) {
+            if (events[e].data.u64 == TAG_SIGNAL)
+                read_signals();
+            else if (events[e].data.u64 == TAG_TIMER)
+                expire_deadlines();
+            else if (events[e].data.u64 == TAG_TUNE) {
+                unsigned long long ticks;
+                if (read(tune_fd, &ticks, sizeof(ticks)) == -1)
+                    continue;
+                long next = adapt_tick(target, pr_limit, running, started - running, pending || !done);
+                if (verbose && next != target)
+                    fprintf(stderr, "%s: [-a] %ld -> %ld commands (%.1f/s, cpu %.0f%%, memory %.0f%%)\n",
+                            exe_name.c_str(), target, next, adapt_sample.rate, adapt_sample.cpu * 100,
+                            adapt_sample.memory * 100);
+                set_target(next);
+                lowest = (target < lowest) ? target : lowest;
+                highest = (target > highest) ? target : highest;
+            }
+            else if (events[e].data.u64 & TAG_PIPE)
+                read_pipe(events[e].data.u64);
+            else
+                reap_job(events[e].data.u64);
+        }
+    }
+    free(line);
+    if (verbose) {
+        set_target(target); // Counts the time since the last change
+        double wall = (target_ns_at - begin_ns) / 1e9;
+        // Against the commands asked for at the time: [-n #], or what [-a] had picked
+        fprintf(stderr, "%s: %ld commands, %ld failed, %.3f s, %.1f commands/s, slot utilization %.1f%%\n",
+                exe_name.c_str(), started, failures, wall, started / wall,
+                (target_ns > 0) ? 100.0 * busy_ns / target_ns : 0.0);
+        if (adaptive)
+            fprintf(stderr, "%s: [-a] ran %.1f commands at once on average, %.1f asked for on average, "
+                    "between %ld and %ld of at most %ld\n", exe_name.c_str(), (wall > 0) ? busy_ns / 1e9 / wall : 0.0,
+                    (wall > 0) ? target_ns / 1e9 / wall : 0.0, lowest, highest, pr_limit);
+    }
+    return (failures == 0 && !stopping) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// The monotonic clock in nanoseconds
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Creates the epoll with the signalfd and timerfd in it. SIGINT and SIGALRM are blocked so
+// they are only read from the signalfd; children get the normal mask back when spawned.
+void setup_events() {
+    // Every child holds a pidfd, let as many be open as we are allowed
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGALRM);
+    sigaddset(&signals, SIGCHLD); // Blocked all along, only read once watch_sigchld is set
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) == -1) {
+        perror("proc_fan: sigprocmask");
+        exit(EXIT_FAILURE);
+    }
+    sigdelset(&signals, SIGCHLD);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd == -1 || signal_fd == -1 || timer_fd == -1) {
+        perror("proc_fan: Cannot set up the event loop");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = TAG_SIGNAL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+    event.data.u64 = TAG_TIMER;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+}
+
+// Used to create a timer for [-s time], it ends up on the signalfd as SIGALRM
+void start_clock(int secs) {
+    struct itimerval time;
+    time.it_value.tv_sec = secs;
+    time.it_value.tv_usec = 0;
+    time.it_interval.tv_sec = 0;
+    time.it_interval.tv_usec = 0;
+    if (setitimer(ITIMER_REAL, &time, NULL) == -1) {
+        perror("Cannot arm the timer for the requested time");
+    }
+}
+
+// Changes how many commands to keep running, adding the old number's time to target_ns
+void set_target(long next) {
+    long long now = now_ns();
+    target_ns += (double) target * (now - target_ns_at);
+    target_ns_at = now;
+    target = next;
+}
+
+// Spawns a command into a free slot and watches its pidfd, and with [-k] its output pipes.
+// Returns 0, or why it couldn't be started.
+int start_job(char** argv, long line_number, struct Record* record) {
+    pid_t pid;
+    int error;
+    if (record == NULL)
+        error = spawn_command(argv, &pid, NULL);
+    else {
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        int write_end[2];
+        error = capture_pipes(record, &actions, write_end);
+        if (error == 0) {
+            error = spawn_command(argv, &pid, &actions);
+            close(write_end[0]); // The child has its own now
+            close(write_end[1]);
+        }
+        posix_spawn_file_actions_destroy(&actions);
+        if (error != 0) {
+            capture_close(record, 0);
+            capture_close(record, 1);
+            return error;
+        }
+        for (int s = 0; s < 2; s++) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = TAG_PIPE | (unsigned long) record | s;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, record->stream[s].pipe_fd, &event);
+        }
+    }
+    if (error != 0)
+        return error;
+    int slot;
+    if (free_slots.empty()) { // Every slot is busy, running has gone past the most so far
+        slot = jobs.size();
+        jobs.resize(slot + 1); // pid 0 until it is filled in below
+    }
+    else {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    }
+    running++;
+    started++;
+    struct Job* job = &jobs[slot];
+    job->pid = pid;
+    job->line = line_number;
+    job->start_ns = now_ns();
+    job->record = record;
+    // The child may have exited already, its pidfd is still readable then: we haven't reaped it
+    job->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (job->pidfd != -1) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = slot;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, job->pidfd, &event);
+    }
+    else if (!watch_sigchld) { // Kernel before 5.3, or out of file descriptors
+        watch_sigchld = true;
+        sigaddset(&signals, SIGCHLD);
+        signalfd(signal_fd, &signals, 0);
+        reap_exited(); // Any that exited before SIGCHLD was read
+    }
+    if (timeout_ns > 0) {
+        struct Deadline deadline = {job->start_ns + timeout_ns, slot, pid};
+        term_queue.push_back(deadline);
+    }
+    return 0;
+}
+
+// Starts argv[0] (looked up in PATH) with its arguments, *pid gets the child. Returns 0, or
+// the error if it couldn't be started: glibc's posix_spawnp() runs the child on our memory
+// (CLONE_VFORK) until the exec, so a command that doesn't exist is reported here too.
+int spawn_command(char** argv, pid_t* pid, posix_spawn_file_actions_t* actions) {
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none); // Ours has SIGINT, SIGALRM and SIGCHLD blocked
+    short flags = POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK; // Only matters on older glibc
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+    int error = posix_spawnp(pid, argv[0], actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    return error;
+}
+
+// Reaps the command in "slot", its pidfd said it has exited
+void reap_job(int slot) {
+    struct Job* job = &jobs[slot];
+    if (job->pid == 0) // A pidfd we closed, still held by a child that was being spawned
+        return;
+    int status;
+    pid_t pid;
+    do {
+        pid = waitpid(job->pid, &status, 0);
+    } while (pid == -1 && errno == EINTR);
+    if (pid == -1) {
+        perror("proc_fan: waitpid");
+        exit(EXIT_FAILURE);
+    }
+    finish_job(slot, status);
+}
+
+// Reaps every command without a pidfd that has exited, after a SIGCHLD
+void reap_exited() {
+    for (long slot = 0; slot < (long) jobs.size(); slot++) {
+        int status;
+        if (jobs[slot].pid != 0 && jobs[slot].pidfd == -1 && waitpid(jobs[slot].pid, &status, WNOHANG) > 0)
+            finish_job(slot, status);
+    }
+}
+
+// Reports the reaped command in "slot" and frees the slot
+void finish_job(int slot, int status) {
+    struct Job* job = &jobs[slot];
+    report_status(job->record, job->line, status);
+    busy_ns += now_ns() - job->start_ns;
+    if (job->record != NULL) // Printed once its pipes are at end of file too, and it is its turn
+        job->record->exited = true;
+    if (job->pidfd != -1) {
+        // Closing alone doesn't take it out of the epoll while another process still has it
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, job->pidfd, NULL);
+        close(job->pidfd);
+    }
+    job->pid = 0;
+    free_slots.push_back(slot);
+    running--;
+}
+
+// Handles everything waiting on the signalfd
+void read_signals() {
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGCHLD) {
+            reap_exited();
+            continue;
+        }
+        if (stopping)
+            continue;
+        if (info.ssi_signo == SIGINT)
+            fprintf(stderr, "CTRL+C was pressed in [%s]\n", exe_name.c_str());
+        else
+            fprintf(stderr, "%s: [-s time] ran out, terminating the running commands\n", exe_name.c_str());
+        stopping = true;
+        long long grace = now_ns() + KILL_GRACE_NS;
+        term_queue.clear(); // They all get SIGTERM now
+        for (long slot = 0; slot < (long) jobs.size(); slot++) {
+            if (jobs[slot].pid != 0) {
+                kill(jobs[slot].pid, SIGTERM);
+                struct Deadline deadline = {grace, (int) slot, jobs[slot].pid};
+                kill_queue.push_back(deadline);
+            }
+        }
+    }
+}
+
+// Sends SIGTERM (then SIGKILL) to commands that ran out of [-t time]
+void expire_deadlines() {
+    unsigned long long expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+        perror("proc_fan: read timerfd");
+    timer_armed_ns = 0;
+    long long now = now_ns();
+    while (!term_queue.empty() && term_queue.front().at_ns <= now) {
+        struct Deadline deadline = term_queue.front();
+        term_queue.pop_front();
+        if (jobs[deadline.slot].pid != deadline.pid) // Done already
+            continue;
+        note(jobs[deadline.slot].record, "%s: line %ld ran out of [-t time], terminating it\n",
+             exe_name.c_str(), jobs[deadline.slot].line);
+        kill(deadline.pid, SIGTERM);
+        deadline.at_ns = now + KILL_GRACE_NS;
+        kill_queue.push_back(deadline);
+    }
+    while (!kill_queue.empty() && kill_queue.front().at_ns <= now) {
+        struct Deadline deadline = kill_queue.front();
+        kill_queue.pop_front();
+        if (jobs[deadline.slot].pid == deadline.pid)
+            kill(deadline.pid, SIGKILL);
+    }
+}
+
+// Sets timer_fd to the earliest deadline, if that changed. Deadlines of commands that are done
+// are dropped first so they don't wake us up for nothing.
+void arm_timer() {
+    while (!term_queue.empty() && jobs[term_queue.front().slot].pid != term_queue.front().pid)
+        term_queue.pop_front();
+    while (!kill_queue.empty() && jobs[kill_queue.front().slot].pid != kill_queue.front().pid)
+        kill_queue.pop_front();
+    long long next = 0;
+    if (!term_queue.empty())
+        next = term_queue.front().at_ns;
+    if (!kill_queue.empty() && (next == 0 || kill_queue.front().at_ns < next))
+        next = kill_queue.front().at_ns;
+    if (next == timer_armed_ns)
+        return;
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when)); // All zero disarms it
+    when.it_value.tv_sec = next / 1000000000LL;
+    when.it_value.tv_nsec = next % 1000000000LL;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &when, NULL);
+    timer_armed_ns = next;
+}
+
+// Splits "line" into arguments where it is, "args" gets a pointer to each and then NULL.
+// Spaces and tabs separate arguments, '...' and "..." quote them and a backslash escapes
+// the next character (inside "..." only " and \). Quotes and backslashes are taken out by
+// moving the rest of the argument back over them, an argument never gets longer so it
+// always fits. Returns the number of arguments, or -1 if a quote isn't closed.
+int split_args(char* line, std::vector<char*>& args) {
+    args.clear();
+    char* in = line;
+    while (true) {
+        while (*in == ' ' || *in == '\t' || *in == '\n' || *in == '\r')
+            in++;
+        if (*in == '\0')
+            break;
+        char* out = in;
+        args.push_back(out);
+        char quote = 0;
+        for (; *in != '\0'; in++) {
+            char c = *in;
+            if (quote != 0) {
+                if (c == quote) {
+                    quote = 0;
+                    continue;
+                }
+                if (c == '\\' && quote == '"' && (in[1] == '"' || in[1] == '\\'))
+                    c = *++in;
+            }
+            else {
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                    break;
+                if (c == '\'' || c == '"') {
+                    quote = c;
+                    continue;
+                }
+                if (c == '\\' && in[1] != '\0' && in[1] != '\n')
+                    c = *++in;
+            }
+            *out++ = c;
+        }
+        if (quote != 0)
+            return -1;
+        bool end = (*in == '\0');
+        *out = '\0'; // May be where *in was, we already know what that was
+        if (end)
+            break;
+        in++;
+    }
+    int count = args.size();
+    args.push_back(NULL);
+    return count;
+}
+
+// Takes what a [-k] pipe has for us, closes it at end of file
+void read_pipe(unsigned long tag) {
+    struct Record* record = (struct Record*) (tag & ~(TAG_PIPE | 1UL));
+    int s = tag & 1;
+    if (!capture_read(record, s))
+        return;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, record->stream[s].pipe_fd, NULL); // Same as for the pidfds
+    capture_close(record, s);
+}
+
+// Prints how the command from line "line_number" ended, if it didn't exit with 0
+void report_status(struct Record* record, long line_number, int status) {
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        return;
+    failures++;
+    if (WIFEXITED(status))
+        note(record, "%s: line %ld exited with status %d\n", exe_name.c_str(), line_number, WEXITSTATUS(status));
+    else if (WIFSIGNALED(status))
+        note(record, "%s: line %ld was killed by signal %d (%s)\n", exe_name.c_str(), line_number,
+             WTERMSIG(status), strsignal(WTERMSIG(status)));
+}
+
+// Prints a message about one command on stderr, with [-k] in order with that command's output
+void note(struct Record* record, const char* format, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (record == NULL)
+        fputs(message, stderr);
+    else
+        capture_note(record, message);
+}
+
+// Prints an error message based on the calling executable
+void errors(std::string name, std::string message) {
+    printf("\n%s: Error: %s\n\n", name.c_str(), message.c_str());
+    usage(name);
+}
+
+// Prints a usage message about how to properly use this program
+void usage(std::string name) {
+    printf("\n%s: Usage: ./proc_fan -n [#] [-a] [-t time] [-s time] [-k] [-v] < commands\n", name.c_str());
+    printf("%s: Help:  ./proc_fan -h\n			[-h] will display how the project should be run and then, terminate.\n", name.c_str());
+    printf("	[-n #] where # is the number of commands running at once, as soon as one exits the next starts.\n");
+    printf("	[-a] changes how many commands run at once from throughput and system pressure, [-n #] is the most. (Default most %d)\n", ADAPT_CEILING);
+    printf("	[-t time] where time is the seconds one command may run before it is terminated. (Default no limit)\n");
+    printf("	[-s time] where time is the seconds proc_fan may run before everything is terminated. (Default no limit)\n");
+    printf("	[-k] keeps the output of every command together and in the order of the lines.\n");
+    printf("	[-v] prints how many commands ran, how fast, and how busy the slots it asked for were.\n");
+    printf("	[commands] standard input, one command line per line.\n\n");
+    exit(EXIT_FAILURE);
+}
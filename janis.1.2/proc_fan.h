@@ -0,0 +1,32 @@
+/* Author: Daniel Janis */
+/* Date: 9/22/2020      */
+#ifndef PROC_FAN_H
+#define PROC_FAN_H
+
+#include <sys/types.h>
+#include <spawn.h>
+#include <string>
+#include <vector>
+
+struct Record;
+
+long long now_ns();
+void setup_events();
+void start_clock(int);
+void set_target(long);
+int start_job(char**, long, struct Record*);
+int spawn_command(char**, pid_t*, posix_spawn_file_actions_t*);
+void reap_job(int);
+void reap_exited();
+void finish_job(int, int);
+void read_signals();
+void expire_deadlines();
+void arm_timer();
+int split_args(char*, std::vector<char*>&);
+void read_pipe(unsigned long);
+void report_status(struct Record*, long, int);
+void note(struct Record*, const char*, ...);
+void errors(std::string, std::string);
+void usage(std::string);
+
+#endif
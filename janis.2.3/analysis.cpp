@@ -0,0 +1,270 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: analysis.cpp
+    Purpose:
+     The analysis modes of palin [-a mode], which report more about a line than whether
+     the whole line is a palindrome. Every line is first normalized the same way the check
+     sees it (punctuation and spaces left out, letters lowercased), remembering where each
+     normalized character was in the original line so results can point back into it.
+     With [-u] the characters are UTF-8 code points, folded and skipped the same way as
+     palin_kernel_utf8() does it (utf8.h), so the palindromes are made of whole characters.
+
+     lps: the longest palindromic substring of the line, found with Manacher's algorithm
+     in linear time. It is reported as its byte offset and length in the original line,
+     followed by the original bytes (punctuation and all).
+
+     distinct/corpus: the number of distinct palindromic substrings of the line, counted
+     with an eertree (palindromic tree) in linear time. It has one node per distinct
+     palindrome, each one a longer palindrome's middle with the same character added to
+     both ends, so adding a character to the line adds at most one node. The nodes and
+     edges come from the arena and are thrown away with it for the next line. With
+     "corpus" every node's hash also goes into a set shared by every worker, so the
+     palindromes no line before had are counted for the whole infile too.
+
+     Nothing here calls malloc per line. Each worker has an Arena that is reset for every
+     line and only grows when a line is longer than any before it.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analysis.h"
+#include "dedup.h"
+#include "utf8.h"
+
+// Makes the arena empty and at least "bytes" big. Anything handed out before is gone.
+void arena_reset(struct Arena* arena, size_t bytes) {
+    arena->used = 0;
+    if (arena->capacity >= bytes)
+        return;
+    size_t capacity = (arena->capacity > 0) ? arena->capacity : 4096;
+    while (capacity < bytes)
+        capacity *= 2;
+    free(arena->base);
+    arena->base = (char*) malloc(capacity);
+    if (arena->base == NULL) {
+        perror("palin: Error: Cannot allocate the scratch arena, terminating");
+        exit(EXIT_FAILURE);
+    }
+    arena->capacity = capacity;
+}
+
+// Hands out "bytes" bytes, 8-byte aligned. arena_reset() has to have made room for them.
+void* arena_alloc(struct Arena* arena, size_t bytes) {
+    bytes = (bytes + 7) & ~(size_t) 7;
+    if (arena->used + bytes > arena->capacity) {
+        fprintf(stderr, "palin: Error: The scratch arena was reset too small, terminating\n");
+        exit(EXIT_FAILURE);
+    }
+    void* memory = arena->base + arena->used;
+    arena->used += bytes;
+    return memory;
+}
+
+// Same rules as the skip table in kernel.cpp: ispunct() or isspace() in the "C" locale
+static inline bool skipped(unsigned char c) {
+    bool space = (c == ' ') || (c >= '\t' && c <= '\r');
+    bool punct = (c > ' ' && c < 127) && !((c >= '0' && c <= '9') ||
+                 (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'));
+    return space || punct;
+}
+
+// Fills "out" with the normalized line, bytes or UTF-8 characters, its text and origin
+// arrays come from the arena
+void normalize(struct Arena* arena, const char* word, int length, bool utf8, struct Normalized* out) {
+    out->text = (unsigned int*) arena_alloc(arena, (length + 1) * sizeof(unsigned int));
+    out->origin = (int*) arena_alloc(arena, (length + 1) * sizeof(int));
+    int n = 0;
+    if (utf8) {
+        const unsigned char* start = (const unsigned char*) word;
+        const unsigned char* c = start;
+        const unsigned char* end = start + length;
+        while (c < end) {
+            int origin = c - start;
+            unsigned int cp = utf8_next(c, end);
+            int entry = casefold_entry(cp);
+            if (casefold_skipped(entry))
+                continue;
+            out->text[n] = casefold_apply(cp, entry);
+            out->origin[n] = origin;
+            n++;
+        }
+    }
+    else {
+        for (int i = 0; i < length; i++) {
+            unsigned char c = word[i];
+            if (skipped(c))
+                continue;
+            out->text[n] = (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+            out->origin[n] = i;
+            n++;
+        }
+    }
+    out->text[n] = 0;
+    out->length = n;
+}
+
+// Manacher's algorithm: finds the longest palindrome in the normalized text, its start and
+// length (in normalized characters) go in *start and *best. odd[i] is how many characters
+// the longest odd palindrome centred on i reaches on each side including i, even[i] the same
+// for the even palindrome whose right half starts at i. [left, right] is the palindrome
+// reaching furthest right so far, anything inside it mirrors a position already worked out.
+void longest_palindrome(const struct Normalized* line, struct Arena* arena, int* start, int* best) {
+    const unsigned int* s = line->text;
+    int n = line->length;
+    int* odd = (int*) arena_alloc(arena, (n + 1) * sizeof(int));
+    int* even = (int*) arena_alloc(arena, (n + 1) * sizeof(int));
+    *start = 0;
+    *best = 0;
+
+    for (int i = 0, left = 0, right = -1; i < n; i++) {
+        int k = (i > right) ? 1 : (odd[left + right - i] < right - i + 1 ? odd[left + right - i] : right - i + 1);
+        while (i - k >= 0 && i + k < n && s[i - k] == s[i + k])
+            k++;
+        odd[i] = k--;
+        if (i + k > right) {
+            left = i - k;
+            right = i + k;
+        }
+        if (2 * odd[i] - 1 > *best) {
+            *best = 2 * odd[i] - 1;
+            *start = i - odd[i] + 1;
+        }
+    }
+    for (int i = 0, left = 0, right = -1; i < n; i++) {
+        int k = (i > right) ? 0 : (even[left + right - i + 1] < right - i + 1 ? even[left + right - i + 1] : right - i + 1);
+        while (i - k - 1 >= 0 && i + k < n && s[i - k - 1] == s[i + k])
+            k++;
+        even[i] = k--;
+        if (i + k > right) {
+            left = i - k - 1;
+            right = i + k;
+        }
+        if (2 * even[i] > *best) {
+            *best = 2 * even[i];
+            *start = i - even[i];
+        }
+    }
+}
+
+// [-a lps]: formats "offset, length, substring" for the line's longest palindromic
+// substring into the arena, *result points at it and its length is returned
+int analyze_lps(struct Arena* arena, const char* word, int length, bool utf8, char** result) {
+    // The normalized text, its origins, the two radius arrays and the result all fit in this
+    arena_reset(arena, 5 * ((size_t) length + 8) * sizeof(int) + 64);
+    struct Normalized line;
+    normalize(arena, word, length, utf8, &line);
+    int start, best;
+    longest_palindrome(&line, arena, &start, &best);
+
+    int offset = 0, bytes = 0; // Where the palindrome is in the original line
+    if (best > 0) {
+        offset = line.origin[start];
+        const unsigned char* last = (const unsigned char*) word + line.origin[start + best - 1];
+        if (utf8) // The last character can be more than one byte
+            utf8_next(last, (const unsigned char*) word + length);
+        else
+            last++;
+        bytes = last - ((const unsigned char*) word + offset);
+    }
+    *result = (char*) arena_alloc(arena, bytes + 32);
+    int prefix = sprintf(*result, "%d, %d, ", offset, bytes);
+    memcpy(*result + prefix, word + offset, bytes);
+    return prefix + bytes;
+}
+
+#define HASH_BASE 0x100000001B3UL // Odd, so powers of it never become 0 modulo 2^64
+
+// Finds the edge leaving node "from" for character c, returns the node it leads to or -1
+static inline int eer_find(const struct EerNode* node, const struct EerEdge* edge, int from, unsigned int c) {
+    for (int e = node[from].edge; e != -1; e = edge[e].next) {
+        if (edge[e].c == c)
+            return edge[e].to;
+    }
+    return -1;
+}
+
+// [-a distinct] and [-a corpus]: builds the eertree of the normalized line and formats
+// "distinct" (or "distinct, new" when "set" isn't NULL) into the arena, *result points at
+// it and its length is returned. With a set, every palindrome's hash is added to it, *added
+// gets how many were new and *full how many didn't fit.
+int analyze_distinct(struct Arena* arena, const char* word, int length, bool utf8, unsigned long* set,
+                     unsigned long slots, long* added, long* full, char** result) {
+    arena_reset(arena, ((size_t) length + 8) * (sizeof(int) + 8 + sizeof(struct EerNode) + sizeof(struct EerEdge)) + 256);
+    struct Normalized line;
+    normalize(arena, word, length, utf8, &line);
+    const unsigned int* s = line.text;
+    int n = line.length;
+    struct EerNode* node = (struct EerNode*) arena_alloc(arena, (n + 2) * sizeof(struct EerNode));
+    struct EerEdge* edge = (struct EerEdge*) arena_alloc(arena, (n + 2) * sizeof(struct EerEdge));
+
+    node[0].length = -1; // Imaginary root, its children are the single characters
+    node[0].link = 0;
+    node[0].edge = -1;
+    node[1].length = 0; // Empty palindrome, its children are the pairs
+    node[1].link = 0;
+    node[1].edge = -1;
+    node[1].hash = 0;
+    node[1].power = 1;
+    int nodes = 2, edges = 0;
+    int last = 1; // Node of the longest palindrome ending at the previous character
+    *added = 0;
+    *full = 0;
+
+    for (int i = 0; i < n; i++) {
+        unsigned int c = s[i];
+        // Longest palindromic suffix that c can be wrapped around (the root -1 always fits)
+        int cur = last;
+        while (i - 1 - node[cur].length < 0 || s[i - 1 - node[cur].length] != c)
+            cur = node[cur].link;
+        int existing = eer_find(node, edge, cur, c);
+        if (existing != -1) { // Not a new palindrome
+            last = existing;
+            continue;
+        }
+
+        int fresh = nodes++;
+        node[fresh].length = node[cur].length + 2;
+        node[fresh].edge = -1;
+        if (node[fresh].length == 1) { // A single character, its suffix is the empty palindrome
+            node[fresh].link = 1;
+            node[fresh].hash = c;
+            node[fresh].power = HASH_BASE;
+        }
+        else {
+            int w = node[cur].link;
+            while (i - 1 - node[w].length < 0 || s[i - 1 - node[w].length] != c)
+                w = node[w].link;
+            node[fresh].link = eer_find(node, edge, w, c);
+            // c + middle + c, read as a number in base HASH_BASE
+            node[fresh].hash = (c * node[cur].power + node[cur].hash) * HASH_BASE + c;
+            node[fresh].power = node[cur].power * HASH_BASE * HASH_BASE;
+        }
+        edge[edges].to = fresh;
+        edge[edges].c = c;
+        edge[edges].next = node[cur].edge;
+        node[cur].edge = edges++;
+        last = fresh;
+
+        if (set != NULL) {
+            unsigned long hash = node[fresh].hash ^ ((unsigned long) node[fresh].length * 0xC2B2AE3D27D4EB4FUL);
+            hash ^= hash >> 33; // The low bits pick the slot, mix every bit into them
+            hash *= 0xFF51AFD7ED558CCDUL;
+            hash ^= hash >> 33;
+            int was = dedup_add(set, slots, hash);
+            if (was == 1)
+                (*added)++;
+            else if (was == -1)
+                (*full)++;
+        }
+    }
+
+    *result = (char*) arena_alloc(arena, 64);
+    if (set != NULL)
+        return sprintf(*result, "%d, %ld", nodes - 2, *added);
+    return sprintf(*result, "%d", nodes - 2);
+}
@@ -0,0 +1,58 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: analysis.h
+*/
+
+#include <stddef.h>
+
+// What palin reports about each line [-a mode]
+enum analysis_type {analysis_none, analysis_lps, analysis_distinct, analysis_corpus};
+
+// Scratch memory a worker reuses for every line: reset at the start of a line, handed out
+// front to back while working on it, and only grown (never freed) when a line needs more
+struct Arena {
+    char* base;
+    size_t used;
+    size_t capacity;
+};
+
+void arena_reset(struct Arena*, size_t);
+void* arena_alloc(struct Arena*, size_t);
+
+// The normalized line (punctuation and spaces left out, letters lowercased) as one value
+// per character, a byte or with [-u] a folded code point, and the byte offset in the
+// original line every normalized character came from
+struct Normalized {
+    unsigned int* text;
+    int* origin;
+    int length;
+};
+
+void normalize(struct Arena*, const char*, int, bool, struct Normalized*);
+void longest_palindrome(const struct Normalized*, struct Arena*, int*, int*);
+int analyze_lps(struct Arena*, const char*, int, bool, char**);
+
+// A node of the eertree, one per distinct palindrome in the line
+struct EerNode {
+    int length; // -1 for the imaginary root, 0 for the empty palindrome
+    int link; // Longest proper palindromic suffix
+    int edge; // First outgoing edge, -1 if none
+    unsigned long hash; // Polynomial hash of the palindrome
+    unsigned long power; // HASH_BASE to the power of its length
+};
+
+// An edge of the eertree: node "to" is character c added to both ends of the node it leaves
+struct EerEdge {
+    int to;
+    int next; // Next edge leaving the same node, -1 if none
+    unsigned int c;
+};
+
+int analyze_distinct(struct Arena*, const char*, int, bool, unsigned long*, unsigned long, long*, long*, char**);
+
+#endif
@@ -0,0 +1,276 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: bench.cpp
+    Purpose:
+     Throughput benchmark for master/palin. It generates a synthetic corpus (number of
+     lines, how their lengths are spread out and how many of them are palindromes), then
+     runs ./master on it for every [-n x]/[-s x] pair in the grid, [-k x] times each. Every
+     run's words/sec, p50/p99 latency per word (read back from the file master writes with
+     [-b file]) and the user/sys CPU time of master and all of its palin children are
+     appended as one row to a CSV file, so runs from different builds can be compared.
+
+     ./bench [-l lines] [-m mean] [-d fixed|uniform|exp] [-r ratio] [-u distinct] [-g corpus]
+             [-n list] [-s list] [-x args] [-k runs] [-o csv]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+
+#define STATS_FILE "bench.stats" // master appends its word count and latency percentiles here
+
+// Seconds on the monotonic clock
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Seconds in a timeval from getrusage()
+double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Length of the next line for the distribution: every line "mean" long, spread evenly
+// between 1 and 2*mean-1, or exponential (lots of short lines and a few very long ones)
+size_t line_length(const char* dist, size_t mean) {
+    if (strcmp(dist, "uniform") == 0)
+        return 1 + rand() % (2 * mean - 1);
+    if (strcmp(dist, "exp") == 0) {
+        double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+        return 1 + (size_t) (-log(u) * (mean - 1));
+    }
+    return mean;
+}
+
+// Fills "line" with "length" bytes of words, a palindrome if "palin" is set. Palindromes
+// flip the case of some letters and have spaces/punctuation mixed in, the check ignores both.
+void make_line(char* line, size_t length, bool palin) {
+    const char* letters = "abcdefghijklmnopqrstuvwxyz";
+    const char* other = " ,.!?'- ";
+    for (size_t i = 0; i < length; i++) {
+        line[i] = letters[rand() % 26];
+        if (rand() % 6 == 0)
+            line[i] = other[rand() % 8];
+    }
+    if (palin) {
+        for (size_t i = 0; i < length / 2; i++) {
+            char c = line[i];
+            if (c >= 'a' && c <= 'z' && rand() % 4 == 0)
+                c = c - 'a' + 'A';
+            line[length - 1 - i] = c;
+        }
+    }
+    else if (length > 1) { // Make sure the ends differ so it can't be a palindrome by chance
+        line[0] = 'a';
+        line[length - 1] = 'b';
+    }
+}
+
+// Writes the corpus file, returns the number of bytes written. With "distinct" above 0 the
+// corpus only has that many different lines, picked at random over and over.
+size_t make_corpus(const char* name, long lines, size_t mean, const char* dist, double ratio, long distinct) {
+    FILE* corpus = fopen(name, "w");
+    if (corpus == NULL) {
+        perror("bench: Error: Cannot open the corpus file for output");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> seen; // The distinct lines, when there is a limit
+    std::vector<char> line;
+    size_t total = 0;
+    for (long i = 0; i < lines; i++) {
+        if (distinct > 0 && (long) seen.size() == distinct) { // Repeat one of them
+            const std::string& again = seen[rand() % distinct];
+            fwrite(again.data(), 1, again.size(), corpus);
+            total += again.size();
+            continue;
+        }
+        size_t length = line_length(dist, mean);
+        line.resize(length + 1);
+        make_line(&line[0], length, rand() < ratio * ((double) RAND_MAX + 1));
+        line[length] = '\n';
+        fwrite(&line[0], 1, length + 1, corpus);
+        total += length + 1;
+        if (distinct > 0)
+            seen.push_back(std::string(&line[0], length + 1));
+    }
+    fclose(corpus);
+    return total;
+}
+
+// Splits "1,2,4" into a list of numbers
+std::vector<int> parse_list(const char* list) {
+    std::vector<int> values;
+    std::string copy = list;
+    for (char* token = strtok(&copy[0], ","); token != NULL; token = strtok(NULL, ","))
+        values.push_back(atoi(token));
+    return values;
+}
+
+// Runs ./master once, returns the wall clock seconds (or -1 if it failed). "user"/"sys"
+// get the CPU time of master and every palin it waited for.
+double run_master(const char* corpus, int n, int s, const char* extra, double* user, double* sys) {
+    unlink("palin.out"); // master and palin append to these, start every run empty
+    unlink("nopalin.out");
+    unlink("output.log");
+    unlink(STATS_FILE);
+
+    std::vector<std::string> args;
+    args.push_back("./master");
+    args.push_back("-n");
+    args.push_back(std::to_string(n));
+    args.push_back("-s");
+    args.push_back(std::to_string(s));
+    args.push_back("-b");
+    args.push_back(STATS_FILE);
+    std::string copy = extra;
+    for (char* token = strtok(&copy[0], " "); token != NULL; token = strtok(NULL, " "))
+        args.push_back(token);
+    args.push_back(corpus);
+    std::vector<char*> argv;
+    for (size_t i = 0; i < args.size(); i++)
+        argv.push_back(&args[i][0]);
+    argv.push_back(NULL);
+
+    struct rusage before, after;
+    getrusage(RUSAGE_CHILDREN, &before);
+    double start = now();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("bench: fork: Error: Cannot start master");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) { // Keep master's and palin's chatter out of the results
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], &argv[0]);
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    double wall = now() - start;
+    getrusage(RUSAGE_CHILDREN, &after); // Includes the palins, master waits for all of them
+    *user = seconds(after.ru_utime) - seconds(before.ru_utime);
+    *sys = seconds(after.ru_stime) - seconds(before.ru_stime);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return wall;
+}
+
+void usage() {
+    printf("Usage: ./bench [-l lines] [-m mean] [-d fixed|uniform|exp] [-r ratio] [-u distinct] [-g corpus]\n");
+    printf("               [-n list] [-s list] [-x args] [-k runs] [-o csv]\n");
+    printf("    [-l lines] lines in the generated corpus (Default: 100000)\n");
+    printf("    [-m mean] mean line length in bytes (Default: 32)\n");
+    printf("    [-d dist] line lengths are fixed, uniform or exp(onential) around the mean (Default: uniform)\n");
+    printf("    [-r ratio] fraction of the lines that are palindromes, 0 to 1 (Default: 0.5)\n");
+    printf("    [-u distinct] only this many different lines, the rest repeat them (Default: 0, every line is new)\n");
+    printf("    [-g corpus] file the corpus is written to (Default: bench.txt)\n");
+    printf("    [-n list] comma separated [-n x] values for master (Default: 27)\n");
+    printf("    [-s list] comma separated [-s x] values for master (Default: 1,2,4,8)\n");
+    printf("    [-x args] extra arguments for master (Default: \"-p\")\n");
+    printf("    [-k runs] runs per grid point (Default: 3)\n");
+    printf("    [-o csv] file the results are appended to (Default: bench.csv)\n");
+}
+
+int main(int argc, char *argv[]) {
+    long lines = 100000;
+    long mean = 32; // Signed, so a negative [-m] is caught below instead of wrapping around
+    const char* dist = "uniform";
+    double ratio = 0.5;
+    long distinct = 0;
+    const char* corpus = "bench.txt";
+    const char* n_list = "27";
+    const char* s_list = "1,2,4,8";
+    const char* extra = "-p";
+    int runs = 3;
+    const char* csv_name = "bench.csv";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:m:d:r:u:g:n:s:x:k:o:h")) != -1) {
+        switch (opt) {
+            case 'l': lines = atol(optarg); break;
+            case 'm': mean = atol(optarg); break;
+            case 'd': dist = optarg; break;
+            case 'r': ratio = atof(optarg); break;
+            case 'u': distinct = atol(optarg); break;
+            case 'g': corpus = optarg; break;
+            case 'n': n_list = optarg; break;
+            case 's': s_list = optarg; break;
+            case 'x': extra = optarg; break;
+            case 'k': runs = atoi(optarg); break;
+            case 'o': csv_name = optarg; break;
+            case 'h': usage(); return 0;
+            default: usage(); return EXIT_FAILURE;
+        }
+    }
+    if (lines < 0 || distinct < 0 || mean < 1 || runs < 1 || ratio < 0 || ratio > 1 ||
+        (strcmp(dist, "fixed") != 0 && strcmp(dist, "uniform") != 0 && strcmp(dist, "exp") != 0)) {
+        fprintf(stderr, "bench: Error: Invalid option, check the usage line below.\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (access("./master", X_OK) != 0 || access("./palin", X_OK) != 0) {
+        fprintf(stderr, "bench: Error: ./master and ./palin have to be built first (make)\n");
+        return EXIT_FAILURE;
+    }
+
+    srand(1); // Same corpus for the same options on every build
+    size_t bytes = make_corpus(corpus, lines, (size_t) mean, dist, ratio, distinct);
+    printf("corpus %s: %ld lines, %zu bytes\n", corpus, lines, bytes);
+
+    bool header = access(csv_name, F_OK) != 0; // New file, name the columns first
+    FILE* csv = fopen(csv_name, "a");
+    if (csv == NULL) {
+        perror("bench: Error: Cannot open the csv file for output");
+        return EXIT_FAILURE;
+    }
+    if (header)
+        fprintf(csv, "lines,mean_len,dist,ratio,n,s,extra,run,words,wall_s,words_per_s,p50_us,p99_us,user_s,sys_s\n");
+
+    std::vector<int> ns = parse_list(n_list);
+    std::vector<int> ss = parse_list(s_list);
+    for (size_t a = 0; a < ns.size(); a++) {
+        for (size_t b = 0; b < ss.size(); b++) {
+            for (int run = 1; run <= runs; run++) {
+                double user, sys;
+                double wall = run_master(corpus, ns[a], ss[b], extra, &user, &sys);
+                if (wall < 0) {
+                    fprintf(stderr, "bench: master failed for -n %d -s %d, skipping\n", ns[a], ss[b]);
+                    continue;
+                }
+                unsigned long words = 0, p50 = 0, p99 = 0;
+                FILE* stats = fopen(STATS_FILE, "r");
+                if (stats != NULL) {
+                    if (fscanf(stats, "words=%lu p50_ns=%lu p99_ns=%lu", &words, &p50, &p99) != 3)
+                        words = p50 = p99 = 0;
+                    fclose(stats);
+                }
+                fprintf(csv, "%ld,%ld,%s,%.3f,%d,%d,\"%s\",%d,%lu,%.6f,%.1f,%.3f,%.3f,%.6f,%.6f\n",
+                        lines, mean, dist, ratio, ns[a], ss[b], extra, run, words, wall,
+                        words / wall, p50 / 1e3, p99 / 1e3, user, sys);
+                fflush(csv);
+                printf("-n %d -s %d %s run %d: %lu words in %.3fs, %.0f words/s, p50 %.1fus, p99 %.1fus, user %.3fs, sys %.3fs\n",
+                       ns[a], ss[b], extra, run, words, wall, words / wall, p50 / 1e3, p99 / 1e3, user, sys);
+            }
+        }
+    }
+    fclose(csv);
+    unlink(STATS_FILE);
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: bench_kernel.cpp
+    Purpose:
+     Microbenchmark for the palindrome kernels in kernel.cpp. For every line length it
+     builds a set of palindromes (worst case, every pair has to be compared) and times
+     each kernel over them, printing the throughput in MB/s of input scanned. "alnum" lines
+     are letters and digits only, "text" lines have spaces and punctuation mixed in at
+     random, and "words" lines read like sentences: short words, a space after each and a
+     comma now and then. Every kernel has to agree with the scalar one or the run stops.
+
+     The u- columns are the UTF-8 kernels [-u] on the same lines, so the cost of decoding
+     and folding against the ASCII kernels shows up side by side. "utf8" lines are mostly
+     ASCII with accented, Greek, Cyrillic, CJK and 4-byte letters (case flipped between the
+     halves), UTF-8 spaces and dashes mixed in. "latin" lines are "words" lines with about
+     one letter in 40 an accented one, like French or German text. Only the UTF-8 kernels
+     get those two.
+
+     ./bench_kernel [max_length]   (Default: 65536)
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <string>
+#include "kernel.h"
+
+struct Kernel {
+    const char* name;
+    kernel_fn fn;
+    bool utf8; // Runs on the "utf8" lines too
+};
+
+// Seconds on the monotonic clock
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills "line" with a palindrome of "length" bytes, with spaces/punctuation if "text" is set
+void make_palindrome(char* line, size_t length, bool text) {
+    const char* alnum = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    const char* other = " ,.!?'- ";
+    for (size_t i = 0; i < (length + 1) / 2; i++) {
+        char c = alnum[rand() % 62];
+        if (text && rand() % 6 == 0)
+            c = other[rand() % 8];
+        line[i] = c;
+        line[length - 1 - i] = c;
+        // Flip the case of one side now and then, the check has to ignore it
+        if (c >= 'a' && c <= 'z' && rand() % 2)
+            line[length - 1 - i] = c - 'a' + 'A';
+    }
+}
+
+// Fills "line" with a UTF-8 palindrome of exactly "length" bytes: characters are picked for
+// the front half, the back half gets them in reverse order with the case of some flipped
+void make_utf8_palindrome(char* line, size_t length) {
+    // Lower and upper case of each letter, the same for the ones without case
+    const char* letters[][2] = {{"a", "A"}, {"q", "Q"}, {"7", "7"}, {"\xC3\xA9", "\xC3\x89"},
+                                {"\xCF\x83", "\xCE\xA3"}, {"\xD1\x8F", "\xD0\xAF"},
+                                {"\xE4\xB8\xAD", "\xE4\xB8\xAD"}, {"\xF0\x90\x90\xA8", "\xF0\x90\x90\x80"},
+                                {" ", " "}, {"\xE3\x80\x80", "\xE3\x80\x80"}, {"\xE2\x80\x94", "\xE2\x80\x94"}};
+    size_t half = length / 2, used = 0;
+    std::vector<const char*> front, back;
+    while (true) {
+        int pick = rand() % 20;
+        pick = (pick < 11) ? 0 : (pick < 13) ? 1 : pick - 11; // Mostly plain ASCII letters
+        if (used + strlen(letters[pick][0]) > half)
+            break;
+        int flip = rand() % 2;
+        front.push_back(letters[pick][flip]);
+        back.push_back(letters[pick][!flip]);
+        used += strlen(letters[pick][0]);
+    }
+    while (used < half) { // Pad up to exactly half the bytes
+        front.push_back("b");
+        back.push_back("B");
+        used++;
+    }
+    char* c = line;
+    for (size_t i = 0; i < front.size(); i++)
+        c = stpcpy(c, front[i]);
+    if (length % 2)
+        *c++ = 'm';
+    for (size_t i = back.size(); i-- > 0; )
+        c = stpcpy(c, back[i]);
+}
+
+// Fills "line" with a palindrome of exactly "length" bytes made of words of 2 to 8 letters,
+// with a space (or a comma and a space) after each. With "accents" about one letter in 40 is
+// an e with an acute accent, two bytes of UTF-8.
+void make_sentence_palindrome(char* line, size_t length, bool accents) {
+    size_t half = length / 2, used = 0;
+    std::vector<std::string> front, back; // back[i] mirrors front[i]
+    int letters = 2 + rand() % 7; // Left in the current word
+    while (true) {
+        std::string f, b;
+        if (letters == 0) {
+            f = (rand() % 5 == 0) ? ", " : " ";
+            b = std::string(f.rbegin(), f.rend());
+            letters = 2 + rand() % 7;
+        }
+        else if (accents && rand() % 40 == 0) {
+            f = "\xC3\xA9";
+            b = (rand() % 2) ? "\xC3\x89" : f; // The same letter in upper case
+            letters--;
+        }
+        else {
+            f = std::string(1, 'a' + rand() % 26);
+            b = (rand() % 8) ? f : std::string(1, f[0] - 'a' + 'A');
+            letters--;
+        }
+        if (used + f.size() > half)
+            break;
+        front.push_back(f);
+        back.push_back(b);
+        used += f.size();
+    }
+    while (used < half) { // Pad up to exactly half the bytes
+        front.push_back("b");
+        back.push_back("B");
+        used++;
+    }
+    char* c = line;
+    for (size_t i = 0; i < front.size(); i++)
+        c = stpcpy(c, front[i].c_str());
+    if (length % 2)
+        *c++ = 'm';
+    for (size_t i = back.size(); i-- > 0; )
+        c = stpcpy(c, back[i].c_str());
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_length = 65536;
+    if (argc > 1)
+        max_length = atol(argv[1]);
+
+    palin_kernel_init();
+    std::vector<Kernel> kernels;
+    kernels.push_back((Kernel) {"scalar", palin_kernel_scalar, false});
+#if defined(__x86_64__) || defined(__i386__)
+    kernels.push_back((Kernel) {"sse2", palin_kernel_sse2, false});
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        kernels.push_back((Kernel) {"avx2", palin_kernel_avx2, false});
+#endif
+    kernels.push_back((Kernel) {"u-scalar", palin_kernel_utf8_scalar, true});
+#if defined(__x86_64__) || defined(__i386__)
+    kernels.push_back((Kernel) {"u-sse2", palin_kernel_utf8_sse2, true});
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        kernels.push_back((Kernel) {"u-avx2", palin_kernel_utf8_avx2, true});
+#endif
+
+    printf("runtime kernel: %s\n\n", palin_kernel_name());
+    printf("%-6s %8s", "input", "length");
+    for (size_t k = 0; k < kernels.size(); k++)
+        printf(" %12s", kernels[k].name);
+    printf("   (MB/s)\n");
+
+    srand(4760);
+    const size_t pool_bytes = 1 << 20; // Each length gets about 1 MB of lines, so they stay in cache
+    const char* inputs[] = {"alnum", "text", "words", "utf8", "latin"};
+    for (int input = 0; input < 5; input++) {
+        bool utf8_only = (input >= 3); // The ASCII kernels get these wrong
+        for (size_t length = 4; length <= max_length; length *= 2) {
+            size_t lines = pool_bytes / length + 1;
+            std::vector<char> pool(lines * length + 4); // make_utf8_palindrome() ends with a '\0'
+            for (size_t i = 0; i < lines; i++) {
+                if (input == 3)
+                    make_utf8_palindrome(&pool[i * length], length);
+                else if (input == 2 || input == 4)
+                    make_sentence_palindrome(&pool[i * length], length, input == 4);
+                else
+                    make_palindrome(&pool[i * length], length, input == 1);
+            }
+
+            printf("%-6s %8zu", inputs[input], length);
+            for (size_t k = 0; k < kernels.size(); k++) {
+                if (utf8_only && !kernels[k].utf8) {
+                    printf(" %12s", "-");
+                    continue;
+                }
+                size_t found = 0, rounds = 0;
+                double start = now(), elapsed;
+                do { // Repeat over the pool for at least 0.2 seconds
+                    for (size_t i = 0; i < lines; i++)
+                        found += kernels[k].fn(&pool[i * length], length);
+                    rounds++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                if (found != lines * rounds) {
+                    fprintf(stderr, "\nbench_kernel: Error: %s missed a palindrome of length %zu\n",
+                            kernels[k].name, length);
+                    exit(EXIT_FAILURE);
+                }
+                printf(" %12.1f", (double) lines * length * rounds / elapsed / 1e6);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
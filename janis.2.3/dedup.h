@@ -0,0 +1,88 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: dedup.h
+*/
+
+#define DEDUP_PROBES 16 // Slots looked at before giving up on a lookup or an insert
+
+/* Cache of verdicts for words seen before [-c slots], shared by every worker. It is an
+   open-addressing table in shared memory, keyed on the hash of the word after normalization
+   (palin_hash() in kernel.cpp), so "Racecar" and "race car!" share an entry. The key is the
+   hash with its lowest bit replaced by the verdict (1 = palindrome), 0 marks an empty slot.
+   Next to it is the "check" palin_hash() also hands back, the normalized length and a second
+   hash worked out with other constants, so two words with the same 64-bit hash still don't
+   share a verdict: a key that matches with a different check is a miss. Entries are only
+   ever added, with a compare-and-swap on an empty key and then the check, so nobody takes a
+   lock. A reader that gets to the key before its check is written takes it as a miss too,
+   and so is a lookup that finds no match in DEDUP_PROBES slots (linear probing from
+   hash % slots). */
+
+struct DedupEntry {
+    unsigned long key; // dedup_key() of the hash with the verdict in bit 0, 0 if the slot is empty
+    unsigned long check; // Normalized length and second hash, 0 until the key's owner writes it
+};
+
+// Entry stored for "hash", never 0
+inline unsigned long dedup_key(unsigned long hash) {
+    hash &= ~1UL;
+    return (hash == 0) ? 2 : hash;
+}
+
+// Looks "hash" (and its "check") up in the table of "slots" entries (a power of two).
+// Returns true and sets *is_palin if the word was seen before.
+inline bool dedup_lookup(struct DedupEntry* table, unsigned long slots, unsigned long hash, unsigned long check, bool* is_palin) {
+    unsigned long key = dedup_key(hash);
+    for (unsigned long probe = 0; probe < DEDUP_PROBES; probe++) {
+        struct DedupEntry* slot = &table[(hash + probe) & (slots - 1)];
+        unsigned long entry = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (entry == 0) // The word would have been put here
+            return false;
+        if ((entry & ~1UL) == key && __atomic_load_n(&slot->check, __ATOMIC_ACQUIRE) == check) {
+            *is_palin = entry & 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds the verdict for "hash" to the table, unless it is already there or every slot it
+// could go in is taken
+inline void dedup_insert(struct DedupEntry* table, unsigned long slots, unsigned long hash, unsigned long check, bool is_palin) {
+    unsigned long key = dedup_key(hash);
+    for (unsigned long probe = 0; probe < DEDUP_PROBES; probe++) {
+        struct DedupEntry* slot = &table[(hash + probe) & (slots - 1)];
+        unsigned long entry = 0;
+        if (__atomic_compare_exchange_n(&slot->key, &entry, key | is_palin, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&slot->check, check, __ATOMIC_RELEASE);
+            return;
+        }
+        if ((entry & ~1UL) == key && __atomic_load_n(&slot->check, __ATOMIC_ACQUIRE) == check)
+            return; // Another worker got there first
+    }
+}
+
+/* The same kind of table used as a set of 64-bit hashes, for [-a corpus]: dedup_add()
+   puts a hash in and says whether it was new. Only the hash is kept, so the verdict bit
+   of an entry is always 0. */
+
+// Returns 1 if "hash" wasn't in the set and has been added, 0 if it was already there, and
+// -1 if every slot it could go in is taken (it isn't added)
+inline int dedup_add(unsigned long* table, unsigned long slots, unsigned long hash) {
+    unsigned long key = dedup_key(hash);
+    for (unsigned long probe = 0; probe < DEDUP_PROBES; probe++) {
+        unsigned long* slot = &table[(hash + probe) & (slots - 1)];
+        unsigned long entry = 0;
+        if (__atomic_compare_exchange_n(slot, &entry, key, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return 1;
+        if (entry == key)
+            return 0;
+    }
+    return -1;
+}
+
+#endif
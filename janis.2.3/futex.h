@@ -0,0 +1,69 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: futex.h
+*/
+
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Sleeps until *addr is woken, returns right away if *addr no longer holds "value".
+// A timeout_ms below 0 waits forever.
+inline void futex_wait(unsigned int* addr, unsigned int value, int timeout_ms = -1) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, addr, FUTEX_WAIT, value, (timeout_ms < 0) ? NULL : &timeout, NULL, 0);
+}
+
+// Wakes up to "count" processes sleeping on addr
+inline void futex_wake(unsigned int* addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+// Tells the CPU we are spinning
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+#define SEQ_SPIN 100 // Checks of a sequence number before going to sleep in the kernel
+
+// Waits until *seq holds "value", sleeping on it if it takes a while. "waiting" counts the
+// sleepers, so seq_publish() only makes a system call when someone is asleep. Returns false
+// if timeout_ms (when it isn't negative) passed first.
+inline bool seq_wait(unsigned int* seq, unsigned int value, unsigned int* waiting, int timeout_ms) {
+    for (int spin = 0; spin < SEQ_SPIN; spin++) {
+        if (__atomic_load_n(seq, __ATOMIC_ACQUIRE) == value)
+            return true;
+        cpu_relax();
+    }
+    unsigned int seen;
+    while ((seen = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) != value) {
+        // Announce the sleep and look once more, so a wake-up can't slip in between
+        __atomic_add_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(seq, __ATOMIC_SEQ_CST) == seen)
+            futex_wait(seq, seen, timeout_ms);
+        __atomic_sub_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+        if (timeout_ms >= 0)
+            return __atomic_load_n(seq, __ATOMIC_ACQUIRE) == value;
+    }
+    return true;
+}
+
+// Stores "value" in *seq and wakes whoever sleeps on it
+inline void seq_publish(unsigned int* seq, unsigned int value, unsigned int* waiting) {
+    __atomic_store_n(seq, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(seq, INT_MAX);
+}
+
+#endif
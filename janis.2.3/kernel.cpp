@@ -0,0 +1,687 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: kernel.cpp
+    Purpose:
+     The palindrome check used by palin. A word is a palindrome if it reads the same
+     both ways once capitalization, punctuation and spaces are ignored. Instead of making
+     a normalized copy, reversing it and comparing the two, the kernel walks in from both
+     ends at once: it skips punctuation/spaces on each side, folds letters to lowercase and
+     compares the pair, so it never allocates and stops at the first mismatch.
+
+     The SSE2/AVX2 versions read 16/32 bytes from each end per step (the block from the
+     back gets reversed first), find the spaces and punctuation in it with a compare mask,
+     pack the rest together and compare what the two ends packed, so text with spaces
+     goes through the blocks too. palin_kernel_init() picks the widest version the CPU
+     supports at runtime, the scalar version is used everywhere else and for the bytes
+     in the middle, fewer than two blocks.
+
+     palin_kernel_utf8() is the same check on UTF-8 text [-u]: the pairs compared are code
+     points instead of bytes, folded with Unicode simple case folding, and everything in the
+     punctuation, symbol and separator categories is skipped (see utf8.h). Blocks of ASCII
+     still go through the SSE2/AVX2 compares above, only the characters from 128 up are
+     decoded one at a time.
+
+*/
+
+#include <string.h>
+#include "kernel.h"
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define MAX_BACKOFF 256 // Most pairs checked one at a time before the SIMD kernels try a block again
+
+static unsigned char skip[256]; // 1 for the bytes ignored by the check (ispunct or isspace)
+static kernel_fn kernel = NULL; // The version palin_kernel() calls, picked by palin_kernel_init()
+static kernel_fn kernel_utf8 = NULL; // The version palin_kernel_utf8() calls
+static const char* kernel_name = "scalar";
+static bool hash_pext = false; // palin_hash() packs bytes with BMI2 pext
+
+// Same as tolower() in the "C" locale, without the function call
+static inline unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+// Hash state for palin_hash(): the normalized bytes are packed 8 at a time into "word" and
+// every full word is mixed into "hash", and into "check" with other constants so the two
+// don't collide on the same words
+struct HashState {
+    unsigned long hash;
+    unsigned long word;
+    int bytes; // Bytes in "word" so far
+    size_t total; // Normalized bytes so far
+    unsigned long check;
+};
+
+#define HASH_SEED 14695981039346656037UL
+#define CHECK_SEED 0x243F6A8885A308D3UL
+
+static inline void hash_word(HashState& h, unsigned long word) {
+    h.hash = (h.hash ^ word) * 0x9E3779B97F4A7C15UL;
+    h.hash ^= h.hash >> 29;
+    h.check = (h.check + word) * 0xD6E8FEB86659FD93UL;
+    h.check ^= h.check >> 32;
+}
+
+// The second value palin_hash() hands back: the normalized length in bits 32-62 and the low
+// 32 bits of "check", with bit 63 set so it is never 0
+static inline unsigned long hash_check(const HashState& h) {
+    unsigned long check = (h.check ^ h.total) * 0xFF51AFD7ED558CCDUL;
+    check ^= check >> 33;
+    return (1UL << 63) | ((h.total & 0x7FFFFFFFUL) << 32) | (check & 0xFFFFFFFFUL);
+}
+
+// Adds one normalized byte
+static inline void hash_raw(HashState& h, unsigned char c) {
+    h.word |= (unsigned long) c << (8 * h.bytes);
+    h.total++;
+    if (++h.bytes == 8) {
+        hash_word(h, h.word);
+        h.word = 0;
+        h.bytes = 0;
+    }
+}
+
+// Adds one byte of the word, unless the check ignores it
+static inline void hash_byte(HashState& h, unsigned char c) {
+    if (!skip[c])
+        hash_raw(h, fold(c));
+}
+
+// Fills the skip table and picks the fastest kernel for this CPU
+void palin_kernel_init() {
+    for (int c = 0; c < 256; c++) {
+        bool space = (c == ' ') || (c >= '\t' && c <= '\r'); // isspace() in the "C" locale
+        bool punct = (c > ' ' && c < 127) && !((c >= '0' && c <= '9') ||
+                     (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')); // ispunct() in the "C" locale
+        skip[c] = space || punct;
+    }
+    kernel = palin_kernel_scalar;
+    kernel_utf8 = palin_kernel_utf8_scalar;
+    kernel_name = "scalar";
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    hash_pext = __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt");
+    if (__builtin_cpu_supports("avx2") && hash_pext) { // The AVX2 kernels pack bytes with pext too
+        kernel = palin_kernel_avx2;
+        kernel_utf8 = palin_kernel_utf8_avx2;
+        kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        kernel = palin_kernel_sse2;
+        kernel_utf8 = palin_kernel_utf8_sse2;
+        kernel_name = "sse2";
+    }
+#endif
+}
+
+// Returns true if the "length" bytes at "word" are a palindrome
+bool palin_kernel(const char* word, size_t length) {
+    if (kernel == NULL)
+        palin_kernel_init();
+    return kernel(word, length);
+}
+
+// Same for UTF-8 text [-u]
+bool palin_kernel_utf8(const char* word, size_t length) {
+    if (kernel_utf8 == NULL)
+        palin_kernel_init();
+    return kernel_utf8(word, length);
+}
+
+// Name of the kernel palin_kernel() is using
+const char* palin_kernel_name() {
+    if (kernel == NULL)
+        palin_kernel_init();
+    return kernel_name;
+}
+
+// Compares at most "pairs" pairs of characters walking in from both ends. lo and hi are
+// moved past what was checked (hi points one past the last character still unchecked).
+// Returns false on a mismatch.
+static inline bool scalar_steps(const unsigned char*& lo, const unsigned char*& hi, size_t pairs) {
+    while (pairs-- > 0) {
+        while (lo < hi && skip[*lo]) // Skip punctuation and spaces at the front,
+            lo++;
+        while (lo < hi && skip[hi[-1]]) // and at the back
+            hi--;
+        if (hi - lo <= 1) { // Met in the middle, everything matched
+            lo = hi;
+            return true;
+        }
+        if (fold(*lo) != fold(hi[-1]))
+            return false;
+        lo++;
+        hi--;
+    }
+    return true;
+}
+
+// scalar_steps() for UTF-8: compares at most "pairs" pairs of code points. Pairs of ASCII
+// bytes are compared like scalar_steps() does, only the rest is decoded.
+static inline bool utf8_steps(const unsigned char*& lo, const unsigned char*& hi, size_t pairs) {
+    while (pairs-- > 0) {
+        while (lo < hi && *lo < 0x80 && skip[*lo])
+            lo++;
+        while (lo < hi && hi[-1] < 0x80 && skip[hi[-1]])
+            hi--;
+        if (hi - lo <= 1) { // Met in the middle (a lone byte is one character either way)
+            lo = hi;
+            return true;
+        }
+        if (*lo < 0x80 && hi[-1] < 0x80) {
+            if (fold(*lo) != fold(hi[-1]))
+                return false;
+            lo++;
+            hi--;
+            continue;
+        }
+        unsigned int front, back;
+        int entry;
+        do { // Next character at the front that isn't skipped,
+            if (lo >= hi)
+                return true;
+            front = utf8_next(lo, hi);
+            entry = casefold_entry(front);
+        } while (casefold_skipped(entry));
+        front = casefold_apply(front, entry);
+        do { // and at the back
+            if (hi <= lo) // The front one was the middle character
+                return true;
+            back = utf8_prev(lo, hi);
+            entry = casefold_entry(back);
+        } while (casefold_skipped(entry));
+        if (front != casefold_apply(back, entry))
+            return false;
+    }
+    return true;
+}
+
+// The steps the kernels take between blocks, bytes or UTF-8 characters
+template <bool utf8>
+static inline bool steps(const unsigned char*& lo, const unsigned char*& hi, size_t pairs) {
+    return utf8 ? utf8_steps(lo, hi, pairs) : scalar_steps(lo, hi, pairs);
+}
+
+// Scalar version, one pair of characters at a time
+template <bool utf8>
+static bool kernel_scalar(const char* word, size_t length) {
+    const unsigned char* lo = (const unsigned char*) word;
+    const unsigned char* hi = lo + length;
+    while (lo < hi) {
+        if (!steps<utf8>(lo, hi, length))
+            return false;
+    }
+    return true;
+}
+
+bool palin_kernel_scalar(const char* word, size_t length) {
+    return kernel_scalar<false>(word, length);
+}
+
+bool palin_kernel_utf8_scalar(const char* word, size_t length) {
+    return kernel_scalar<true>(word, length);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Mask of the bytes the check doesn't skip: letters and digits, and everything that is
+// neither ispunct() nor isspace() (control characters below '\t' or between '\r' and ' ',
+// DEL and all bytes from 128 up), like the skip table
+__attribute__((target("sse2")))
+static inline unsigned int keep_16(__m128i v) {
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i control = _mm_sub_epi8(v, _mm_set1_epi8(0x0E));
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(25)), letter);
+    control = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(0x1F - 0x0E)), control);
+    __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x08)), v);
+    __m128i high = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x7F)), v);
+    __m128i keep = _mm_or_si128(_mm_or_si128(digit, letter), _mm_or_si128(control, _mm_or_si128(low, high)));
+    return _mm_movemask_epi8(keep);
+}
+
+// Letters and digits: (v - '0') < 10 or ((v | 0x20) - 'a') < 26, as unsigned bytes
+__attribute__((target("sse2")))
+static inline bool alnum_16(__m128i v) {
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(25)), letter);
+    return _mm_movemask_epi8(_mm_or_si128(digit, letter)) == 0xFFFF;
+}
+
+// Folds the uppercase letters, same as fold() on every byte
+__attribute__((target("sse2")))
+static inline __m128i fold_16(__m128i v) {
+    __m128i upper = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    upper = _mm_cmpeq_epi8(_mm_min_epu8(upper, _mm_set1_epi8(25)), upper);
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+// Reverses the 16 bytes, SSE2 has no byte shuffle so swap bytes, then words, then dwords
+__attribute__((target("sse2")))
+static inline __m128i reverse_16(__m128i v) {
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+// Folds the block and appends the bytes the check keeps to "out", packed together. Returns
+// how many there were.
+__attribute__((target("sse2")))
+static inline size_t pack_16(unsigned char* out, __m128i v) {
+    unsigned int keep = keep_16(v);
+    v = fold_16(v);
+    if (keep == 0xFFFF) { // A run of letters, nothing to take out
+        _mm_storeu_si128((__m128i*) out, v);
+        return 16;
+    }
+    unsigned char bytes[16];
+    _mm_storeu_si128((__m128i*) bytes, v);
+    size_t n = 0;
+    for (; keep != 0; keep &= keep - 1) // SSE2 has no way to pack bytes, go over the mask
+        out[n++] = bytes[__builtin_ctz(keep)];
+    return n;
+}
+
+// Moves lo back and hi forward over the kept bytes that were read into the SIMD kernels'
+// buffers but not compared yet, "front" of them before lo and "back" of them after hi, so
+// the one-at-a-time steps check them again. The bytes read were all ASCII.
+static inline void unread(const unsigned char*& lo, const unsigned char*& hi, size_t front, size_t back) {
+    while (front > 0) {
+        lo--;
+        if (!skip[*lo])
+            front--;
+    }
+    while (back > 0) {
+        if (!skip[*hi])
+            back--;
+        hi++;
+    }
+}
+
+// SSE2 block loop: reads 16 bytes at a time from each end, packs the bytes the check keeps
+// (folded) into a buffer per end, the back one in reverse, and compares the two buffers as
+// far as both are filled. Spaces and punctuation only take up a few bits of a mask, so
+// ordinary text goes through here as well as runs of letters. Stops once the ends are less
+// than two blocks apart (or, for [-u], at a block with a byte from 128 up) with lo and hi
+// at the first characters not compared yet. Returns false on a mismatch.
+template <bool utf8>
+__attribute__((target("sse2")))
+static bool blocks_sse2(const unsigned char*& lo, const unsigned char*& hi) {
+    const unsigned char* l = lo; // Kept in registers, lo and hi are only set at the end
+    const unsigned char* h = hi;
+    unsigned char front[64], back[64]; // Kept bytes not compared yet, fewer than 32 in each
+    size_t nf = 0, nb = 0;
+    while (h - l >= 32) {
+        if (nf == 0 && nb == 0) { // Nothing waiting: two runs of letters and digits are compared as they are
+            __m128i f = _mm_loadu_si128((const __m128i*) l);
+            __m128i b = _mm_loadu_si128((const __m128i*) (h - 16));
+            if (alnum_16(f) && alnum_16(b)) { // Letters and digits are lowercase with bit 5 set
+                b = reverse_16(_mm_or_si128(b, _mm_set1_epi8(0x20)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(f, _mm_set1_epi8(0x20)), b)) != 0xFFFF)
+                    return false;
+                l += 16;
+                h -= 16;
+                continue;
+            }
+        }
+        if (nf < 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*) l);
+            if (utf8 && _mm_movemask_epi8(v) != 0)
+                break;
+            nf += pack_16(front + nf, v);
+            l += 16;
+        }
+        if (nb < 16) { // Still at least 16 bytes past l
+            __m128i v = _mm_loadu_si128((const __m128i*) (h - 16));
+            if (utf8 && _mm_movemask_epi8(v) != 0)
+                break;
+            nb += pack_16(back + nb, reverse_16(v));
+            h -= 16;
+        }
+        size_t same = (nf < nb) ? nf : nb;
+        for (size_t i = 0; i < same; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*) (front + i));
+            __m128i b = _mm_loadu_si128((const __m128i*) (back + i));
+            unsigned int differ = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xFFFF;
+            if (same - i < 16) // Past the end of one of them
+                differ &= (1u << (same - i)) - 1;
+            if (differ != 0)
+                return false;
+        }
+        // Move what is left to the start of each buffer (at most 31 bytes, in two blocks)
+        __m128i f0 = _mm_loadu_si128((const __m128i*) (front + same));
+        __m128i f1 = _mm_loadu_si128((const __m128i*) (front + same + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*) (back + same));
+        __m128i b1 = _mm_loadu_si128((const __m128i*) (back + same + 16));
+        _mm_storeu_si128((__m128i*) front, f0);
+        _mm_storeu_si128((__m128i*) (front + 16), f1);
+        _mm_storeu_si128((__m128i*) back, b0);
+        _mm_storeu_si128((__m128i*) (back + 16), b1);
+        nf -= same;
+        nb -= same;
+    }
+    unread(l, h, nf, nb);
+    lo = l;
+    hi = h;
+    return true;
+}
+
+// SSE2 version, 16 bytes from each end per step. A block of ASCII is a block of UTF-8
+// characters too, so [-u] only decodes the characters from 128 up, one at a time.
+template <bool utf8>
+__attribute__((target("sse2")))
+static bool kernel_sse2(const char* word, size_t length) {
+    const unsigned char* lo = (const unsigned char*) word;
+    const unsigned char* hi = lo + length;
+    size_t backoff = 16; // Pairs to check one at a time after a block past ASCII
+    while (hi - lo >= 32) {
+        const unsigned char* was = lo;
+        if (!blocks_sse2<utf8>(lo, hi))
+            return false;
+        if (hi - lo < 32)
+            break;
+        if (lo != was) // The blocks got somewhere, try them again soon
+            backoff = 16;
+        if (!steps<utf8>(lo, hi, backoff))
+            return false;
+        if (backoff < MAX_BACKOFF) // Text full of other scripts stops trying blocks so often
+            backoff *= 2;
+    }
+    while (lo < hi) {
+        if (!steps<utf8>(lo, hi, length))
+            return false;
+    }
+    return true;
+}
+
+bool palin_kernel_sse2(const char* word, size_t length) {
+    return kernel_sse2<false>(word, length);
+}
+
+bool palin_kernel_utf8_sse2(const char* word, size_t length) {
+    return kernel_sse2<true>(word, length);
+}
+
+__attribute__((target("avx2")))
+static inline bool alnum_32(__m256i v) {
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(25)), letter);
+    return _mm256_movemask_epi8(_mm256_or_si256(digit, letter)) == -1;
+}
+
+// keep_16() for 32 bytes
+__attribute__((target("avx2")))
+static inline unsigned int keep_32(__m256i v) {
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i control = _mm256_sub_epi8(v, _mm256_set1_epi8(0x0E));
+    digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(25)), letter);
+    control = _mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8(0x1F - 0x0E)), control);
+    __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x08)), v);
+    __m256i high = _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(0x7F)), v);
+    __m256i keep = _mm256_or_si256(_mm256_or_si256(digit, letter), _mm256_or_si256(control, _mm256_or_si256(low, high)));
+    return _mm256_movemask_epi8(keep);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_32(__m256i v) {
+    __m256i upper = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    upper = _mm256_cmpeq_epi8(_mm256_min_epu8(upper, _mm256_set1_epi8(25)), upper);
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+// Reverses the bytes in each 128-bit lane, then swaps the two lanes
+__attribute__((target("avx2")))
+static inline __m256i reverse_32(__m256i v) {
+    const __m256i order = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                           15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    v = _mm256_shuffle_epi8(v, order);
+    return _mm256_permute2x128_si256(v, v, 0x01);
+}
+
+// pack_16() for 32 bytes, packing 8 at a time with pext (BMI2). Writes up to 32 bytes past
+// what it returns.
+__attribute__((target("avx2,bmi2,popcnt")))
+static inline size_t pack_32(unsigned char* out, __m256i v) {
+    unsigned int keep = keep_32(v);
+    v = fold_32(v);
+    if (keep == 0xFFFFFFFF) {
+        _mm256_storeu_si256((__m256i*) out, v);
+        return 32;
+    }
+    unsigned long quarters[4];
+    _mm256_storeu_si256((__m256i*) quarters, v);
+    size_t n = 0;
+    for (int q = 0; q < 4; q++) {
+        unsigned int mask = (keep >> (8 * q)) & 0xFF;
+        unsigned long packed = _pext_u64(quarters[q], _pdep_u64(mask, 0x0101010101010101UL) * 0xFF);
+        memcpy(out + n, &packed, 8);
+        n += __builtin_popcount(mask);
+    }
+    return n;
+}
+
+// blocks_sse2() 32 bytes at a time, until the ends are less than 64 bytes apart
+template <bool utf8>
+__attribute__((target("avx2,bmi2,popcnt")))
+static bool blocks_avx2(const unsigned char*& lo, const unsigned char*& hi) {
+    const unsigned char* l = lo; // Kept in registers, lo and hi are only set at the end
+    const unsigned char* h = hi;
+    unsigned char front[128], back[128]; // Fewer than 64 in each
+    size_t nf = 0, nb = 0;
+    while (h - l >= 64) {
+        if (nf == 0 && nb == 0) {
+            __m256i f = _mm256_loadu_si256((const __m256i*) l);
+            __m256i b = _mm256_loadu_si256((const __m256i*) (h - 32));
+            if (alnum_32(f) && alnum_32(b)) {
+                b = reverse_32(_mm256_or_si256(b, _mm256_set1_epi8(0x20)));
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(f, _mm256_set1_epi8(0x20)), b)) != -1)
+                    return false;
+                l += 32;
+                h -= 32;
+                continue;
+            }
+        }
+        if (nf < 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) l);
+            if (utf8 && _mm256_movemask_epi8(v) != 0)
+                break;
+            nf += pack_32(front + nf, v);
+            l += 32;
+        }
+        if (nb < 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (h - 32));
+            if (utf8 && _mm256_movemask_epi8(v) != 0)
+                break;
+            nb += pack_32(back + nb, reverse_32(v));
+            h -= 32;
+        }
+        size_t same = (nf < nb) ? nf : nb;
+        for (size_t i = 0; i < same; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*) (front + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*) (back + i));
+            unsigned int differ = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+            if (same - i < 32)
+                differ &= (1u << (same - i)) - 1;
+            if (differ != 0)
+                return false;
+        }
+        __m256i f0 = _mm256_loadu_si256((const __m256i*) (front + same));
+        __m256i f1 = _mm256_loadu_si256((const __m256i*) (front + same + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*) (back + same));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*) (back + same + 32));
+        _mm256_storeu_si256((__m256i*) front, f0);
+        _mm256_storeu_si256((__m256i*) (front + 32), f1);
+        _mm256_storeu_si256((__m256i*) back, b0);
+        _mm256_storeu_si256((__m256i*) (back + 32), b1);
+        nf -= same;
+        nb -= same;
+    }
+    unread(l, h, nf, nb);
+    lo = l;
+    hi = h;
+    return true;
+}
+
+// AVX2 version, 32 bytes from each end per step
+template <bool utf8>
+__attribute__((target("avx2,bmi2,popcnt")))
+static bool kernel_avx2(const char* word, size_t length) {
+    const unsigned char* lo = (const unsigned char*) word;
+    const unsigned char* hi = lo + length;
+    size_t backoff = 32;
+    while (hi - lo >= 64) {
+        const unsigned char* was = lo;
+        if (!blocks_avx2<utf8>(lo, hi))
+            return false;
+        if (hi - lo < 64)
+            break;
+        if (lo != was)
+            backoff = 32;
+        if (!steps<utf8>(lo, hi, backoff))
+            return false;
+        if (backoff < MAX_BACKOFF)
+            backoff *= 2;
+    }
+    return kernel_sse2<utf8>((const char*) lo, hi - lo); // Finish the middle 16 bytes at a time
+}
+
+bool palin_kernel_avx2(const char* word, size_t length) {
+    return kernel_avx2<false>(word, length);
+}
+
+bool palin_kernel_utf8_avx2(const char* word, size_t length) {
+    return kernel_avx2<true>(word, length);
+}
+
+// Adds "count" packed bytes (the low bytes of "packed") to the hash
+static inline void hash_bytes(HashState& h, unsigned long packed, int count) {
+    if (count == 0)
+        return;
+    h.total += count;
+    h.word |= packed << (8 * h.bytes);
+    if (h.bytes + count < 8) {
+        h.bytes += count;
+        return;
+    }
+    int used = 8 - h.bytes; // Bytes of "packed" that went into this word
+    hash_word(h, h.word);
+    h.word = (used == 8) ? 0 : packed >> (8 * used);
+    h.bytes = h.bytes + count - 8;
+}
+
+// Hashes 16 bytes at a time for palin_hash(): uppercase letters are folded, and for each
+// half the bytes the check doesn't skip are packed together with pext (BMI2) and added to
+// the hash at once. Returns where it stopped, the caller finishes byte by byte. With
+// "ascii" set it also stops at the first block with a byte from 128 up.
+__attribute__((target("sse2,bmi2,popcnt")))
+static size_t hash_blocks(HashState& h, const unsigned char* c, size_t length, bool ascii) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (c + i));
+        if (ascii && _mm_movemask_epi8(v) != 0)
+            break;
+        unsigned int keep = keep_16(v);
+        v = fold_16(v);
+        unsigned long halves[2];
+        _mm_storeu_si128((__m128i*) halves, v);
+        for (int half = 0; half < 2; half++) {
+            unsigned int mask = (keep >> (8 * half)) & 0xFF;
+            unsigned long bytes = _pdep_u64(mask, 0x0101010101010101UL) * 0xFF; // 0xFF per kept byte
+            hash_bytes(h, _pext_u64(halves[half], bytes), __builtin_popcount(mask));
+        }
+    }
+    return i;
+}
+
+#endif
+
+// 64-bit hash of the word as the check sees it, with punctuation and spaces left out and
+// letters folded to lowercase, so words that only differ in those get the same hash. The
+// normalized bytes are mixed in 8 at a time, packed 16 input bytes at a time with BMI2 when
+// the CPU has it. *check gets the normalized length and a second hash (hash_check()), for
+// telling apart two words that got the same 64-bit hash.
+unsigned long palin_hash(const char* word, size_t length, unsigned long* check) {
+    if (kernel == NULL)
+        palin_kernel_init();
+    const unsigned char* c = (const unsigned char*) word;
+    HashState h = {HASH_SEED, 0, 0, 0, CHECK_SEED};
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (hash_pext)
+        i = hash_blocks(h, c, length, false);
+#endif
+    for (; i < length; i++)
+        hash_byte(h, c[i]);
+    if (h.bytes > 0)
+        hash_word(h, h.word);
+    *check = hash_check(h);
+    return h.hash ^ (h.total * 0xC2B2AE3D27D4EB4FUL); // Tells "a" and "a" followed by a 0 byte apart
+}
+
+// palin_hash() for [-u]: the hash of the word as palin_kernel_utf8() sees it. Every character
+// that isn't skipped is folded and added as its UTF-8 bytes (an invalid byte as 0xFF and the
+// byte, 0xFF never shows up in UTF-8), so ASCII words hash the same as with palin_hash() and
+// ASCII runs go through the same 16-byte blocks.
+unsigned long palin_hash_utf8(const char* word, size_t length, unsigned long* check) {
+    if (kernel == NULL)
+        palin_kernel_init();
+    const unsigned char* c = (const unsigned char*) word;
+    const unsigned char* end = c + length;
+    HashState h = {HASH_SEED, 0, 0, 0, CHECK_SEED};
+    while (c < end) {
+        const unsigned char* stop = end;
+#if defined(__x86_64__) || defined(__i386__)
+        if (hash_pext) {
+            c += hash_blocks(h, c, end - c, true);
+            if (end - c > 16) // Decode the block that had something past ASCII, then try blocks again
+                stop = c + 16;
+        }
+#endif
+        while (c < stop) {
+            unsigned int cp = utf8_next(c, end);
+            int entry = casefold_entry(cp);
+            if (casefold_skipped(entry))
+                continue;
+            cp = casefold_apply(cp, entry);
+            if (cp < 0x80)
+                hash_raw(h, cp);
+            else if (cp < 0x800) {
+                hash_raw(h, 0xC0 | (cp >> 6));
+                hash_raw(h, 0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000) {
+                hash_raw(h, 0xE0 | (cp >> 12));
+                hash_raw(h, 0x80 | ((cp >> 6) & 0x3F));
+                hash_raw(h, 0x80 | (cp & 0x3F));
+            }
+            else if (cp < UTF8_INVALID) {
+                hash_raw(h, 0xF0 | (cp >> 18));
+                hash_raw(h, 0x80 | ((cp >> 12) & 0x3F));
+                hash_raw(h, 0x80 | ((cp >> 6) & 0x3F));
+                hash_raw(h, 0x80 | (cp & 0x3F));
+            }
+            else {
+                hash_raw(h, 0xFF);
+                hash_raw(h, cp - UTF8_INVALID);
+            }
+        }
+    }
+    if (h.bytes > 0)
+        hash_word(h, h.word);
+    *check = hash_check(h);
+    return h.hash ^ (h.total * 0xC2B2AE3D27D4EB4FUL);
+}
@@ -0,0 +1,31 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: kernel.h
+*/
+
+#include <stddef.h>
+
+typedef bool (*kernel_fn)(const char*, size_t);
+
+void palin_kernel_init();
+bool palin_kernel(const char*, size_t);
+const char* palin_kernel_name();
+unsigned long palin_hash(const char*, size_t, unsigned long*);
+bool palin_kernel_utf8(const char*, size_t);
+unsigned long palin_hash_utf8(const char*, size_t, unsigned long*);
+
+bool palin_kernel_scalar(const char*, size_t);
+bool palin_kernel_utf8_scalar(const char*, size_t);
+#if defined(__x86_64__) || defined(__i386__)
+bool palin_kernel_sse2(const char*, size_t);
+bool palin_kernel_avx2(const char*, size_t);
+bool palin_kernel_utf8_sse2(const char*, size_t);
+bool palin_kernel_utf8_avx2(const char*, size_t);
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: latency.h
+*/
+
+#include <time.h>
+
+/* Histogram of per-word latencies in nanoseconds. Below 16ns every value has its own
+   bucket, above that every power of two is split into 8 buckets, so a percentile read
+   back from it is within 12.5% of the real value. */
+#define LATENCY_BUCKETS (16 + 60 * 8)
+
+// Nanoseconds on the monotonic clock
+inline unsigned long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+// Bucket that holds "ns"
+inline int latency_bucket(unsigned long ns) {
+    if (ns < 16)
+        return (int) ns;
+    int power = 63 - __builtin_clzl(ns); // 4 and up
+    return 16 + (power - 4) * 8 + (int) ((ns >> (power - 3)) & 7);
+}
+
+// Smallest value that lands in "bucket"
+inline unsigned long latency_value(int bucket) {
+    if (bucket < 16)
+        return bucket;
+    int power = (bucket - 16) / 8 + 4;
+    return (8UL + (bucket - 16) % 8) << (power - 3);
+}
+
+// Adds one word's latency to the histogram, from any process
+inline void latency_add(unsigned long* histogram, unsigned long ns) {
+    __atomic_add_fetch(&histogram[latency_bucket(ns)], 1, __ATOMIC_RELAXED);
+}
+
+// Returns the latency "percent" percent of the words were at or below (0 if there are none)
+inline unsigned long latency_percentile(const unsigned long* histogram, double percent) {
+    unsigned long total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+        total += histogram[i];
+    if (total == 0)
+        return 0;
+    unsigned long rank = (unsigned long) (total * percent / 100.0 + 0.5);
+    if (rank == 0)
+        rank = 1;
+    unsigned long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= rank)
+            return latency_value(i);
+    }
+    return latency_value(LATENCY_BUCKETS - 1);
+}
+
+#endif
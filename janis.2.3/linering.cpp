@@ -0,0 +1,122 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: linering.cpp
+    Purpose:
+     A bounded ring of lines in shared memory, used when master reads its words from stdin.
+     master puts every line in as soon as it has read it and the pool of palin workers take
+     them out, so checking starts on the first line while later ones are still arriving.
+     The ring never holds more than LINE_SLOTS slots: when the palins fall behind, master
+     sleeps until one is handed back, so it stops reading stdin and the producer on the
+     other end of the pipe is held up too.
+
+     It works like the log ring (logring.cpp) turned around: master writes slots in order
+     and marks each one written through its seq number, a palin claims a whole line by
+     moving tail past all of its slots with a compare-and-swap, copies the text out and
+     hands each slot back by moving its seq number a full lap ahead. Everybody who has to
+     wait sleeps on the slot they are waiting for, on a futex.
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include "futex.h"
+#include "linering.h"
+
+// Sets up an empty ring, every slot is free for the position it will hold first
+void linering_init(struct LineRing* ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->closed = 0;
+    ring->writer_waiting = 0;
+    ring->readers_waiting = 0;
+    for (unsigned int i = 0; i < LINE_SLOTS; i++) {
+        ring->slot[i].seq = i;
+    }
+}
+
+// Master: puts line "index" into the ring, waiting for palins to free up slots if it is full.
+// A line of any length fits, its slots are handed out one at a time as the palin copies them.
+// Returns false if the ring got closed while waiting (master was interrupted and the palins
+// are being killed, nobody will free a slot).
+bool linering_put(struct LineRing* ring, long index, const char* text, size_t length) {
+    int records = (length + LINE_TEXT - 1) / LINE_TEXT;
+    if (records == 0) // An empty line still needs a slot
+        records = 1;
+    unsigned int pos = ring->head;
+    for (int k = 0; k < records; k++) {
+        struct LineSlot* slot = &ring->slot[(pos + k) % LINE_SLOTS];
+        while (!seq_wait(&slot->seq, pos + k, &ring->writer_waiting, LINE_WAIT_MS)) { // Back-pressure
+            if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+                return false;
+        }
+        size_t chunk = length - k * LINE_TEXT;
+        if (chunk > LINE_TEXT)
+            chunk = LINE_TEXT;
+        slot->records = records;
+        slot->length = length;
+        slot->index = index;
+        memcpy(slot->text, text + k * LINE_TEXT, chunk);
+        seq_publish(&slot->seq, pos + k + 1, &ring->readers_waiting);
+    }
+    __atomic_store_n(&ring->head, pos + records, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Master: there are no more lines, palins waiting on an empty ring give up
+void linering_close(struct LineRing* ring) {
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ring->slot[ring->head % LINE_SLOTS].seq, INT_MAX); // Where the idle palins sleep
+}
+
+// palin: takes the next line out of the ring and copies it into *buf (grown with realloc
+// to *capacity bytes when it is too small), its length goes in *length. Returns the line's
+// index, or -1 once master has closed the ring and every line has been taken.
+long linering_take(struct LineRing* ring, char** buf, size_t* capacity, int* length) {
+    unsigned int tail;
+    struct LineSlot* first;
+    while (1) {
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        first = &ring->slot[tail % LINE_SLOTS];
+        unsigned int seen = __atomic_load_n(&first->seq, __ATOMIC_ACQUIRE);
+        if (seen == tail + 1) { // Written, try to claim the whole line
+            unsigned int records = first->records;
+            if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + records, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                break;
+            continue; // Another palin got it first
+        }
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) &&
+            tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+            return -1;
+        // Nothing to take yet, sleep on the slot the next line will start in. Check that
+        // nobody claimed it in the meantime, then master can't skip waking us.
+        __atomic_add_fetch(&ring->readers_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail &&
+            __atomic_load_n(&first->seq, __ATOMIC_SEQ_CST) == seen &&
+            !__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST))
+            futex_wait(&first->seq, seen);
+        __atomic_sub_fetch(&ring->readers_waiting, 1, __ATOMIC_SEQ_CST);
+    }
+
+    // The line is ours, copy it out and hand every slot back as soon as it is copied
+    int records = first->records;
+    long index = first->index;
+    *length = first->length;
+    if (*capacity < (size_t) *length + 1) {
+        *capacity = *length + 1;
+        *buf = (char*) realloc(*buf, *capacity);
+    }
+    for (int k = 0; k < records; k++) {
+        struct LineSlot* slot = &ring->slot[(tail + k) % LINE_SLOTS];
+        seq_wait(&slot->seq, tail + k + 1, &ring->readers_waiting, -1); // master may still be writing it
+        int chunk = *length - k * LINE_TEXT;
+        if (chunk > LINE_TEXT)
+            chunk = LINE_TEXT;
+        memcpy(*buf + k * LINE_TEXT, slot->text, chunk);
+        seq_publish(&slot->seq, tail + k + LINE_SLOTS, &ring->writer_waiting);
+    }
+    return index;
+}
@@ -0,0 +1,42 @@
+#ifndef LINERING_H
+#define LINERING_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: linering.h
+*/
+
+#include <stddef.h>
+
+#define LINE_SLOTS 1024 // Slots in the ring, a power of two
+#define LINE_TEXT 104 // Bytes of the line carried by each slot (the slot is two cache lines)
+#define LINE_WAIT_MS 100 // master looks whether it was interrupted this often while the ring is full
+
+// One fixed-size slot. A line longer than LINE_TEXT is carried by several slots in a row,
+// the first one holds the details and the ones after it only hold more of the text.
+struct LineSlot {
+    unsigned int seq; // == position while free for that position, position+1 once written
+    int records; // Number of slots this line takes up
+    int length; // Length of the whole line, without its newline
+    long index; // Line number in the input, counting from 0
+    char text[LINE_TEXT]; // Up to LINE_TEXT bytes of the line
+} __attribute__((aligned(64)));
+
+// master is the only one that puts lines in, every palin takes them out
+struct LineRing {
+    unsigned int head __attribute__((aligned(64))); // Next position master writes
+    unsigned int writer_waiting; // 1 while master is asleep because the ring is full
+    unsigned int closed; // 1 once master put in the last line
+    unsigned int tail __attribute__((aligned(64))); // Next line a palin can claim
+    unsigned int readers_waiting; // palins asleep because the ring is empty
+    struct LineSlot slot[LINE_SLOTS];
+};
+
+void linering_init(struct LineRing*);
+bool linering_put(struct LineRing*, long, const char*, size_t);
+void linering_close(struct LineRing*);
+long linering_take(struct LineRing*, char**, size_t*, int*);
+
+#endif
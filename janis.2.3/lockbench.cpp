@@ -0,0 +1,560 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: lockbench.cpp
+    Purpose:
+     Benchmark for locks between processes. For every lock and every process count it
+     forks that many processes over one block of shared memory, lets them all take the
+     lock over and over for [-d ms], and reports:
+      - acquisitions per second, all processes together
+      - fairness: the most acquisitions one process got over the fewest (1.00 is fair)
+      - the CPU time burned while waiting: the CPU time of all the processes, minus the
+        time the critical section and the work between acquisitions take on their own
+        (timed once at the start), per acquisition and in total
+     Every critical section increments a plain counter, which has to match the number of
+     acquisitions at the end or the lock didn't keep processes apart ("BROKEN").
+
+     The locks:
+      - em: Eisenberg-McGuire, the flag/turn algorithm from palin's [-l em]
+      - bakery: Lamport's bakery algorithm
+      - ticket: a ticket lock, waiters spin on the ticket being served
+      - mcs: the MCS queue lock, every waiter spins on its own cache line
+      - futex: a mutex that sleeps in the kernel when it is taken (0 free, 1 taken,
+               2 taken with sleepers)
+      - qlock: palin's [-l futex] lock (qlock.cpp), a ticket lock whose waiters sleep
+      - pthread: a PTHREAD_PROCESS_SHARED pthread mutex
+      - sysv: a System V semaphore
+
+     The spinning locks never yield, like palin's: with more processes than CPUs the one
+     that is next often isn't running, which is exactly what the numbers show. A run that
+     doesn't finish within 10 times [-d ms] plus 5 seconds is killed and reported.
+
+     ./lockbench [-l list] [-p list] [-d ms] [-c iterations] [-w iterations] [-o csv]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+#include <string>
+#include <vector>
+#include "futex.h"
+#include "qlock.h"
+
+#define LAB_MAX 64 // Most processes in one run
+
+// A counter on a cache line of its own
+struct Padded {
+    unsigned long value;
+} __attribute__((aligned(64)));
+
+// One process's place in the MCS queue
+struct McsNode {
+    unsigned int next; // Index + 1 of the process queued behind this one, 0 if none yet
+    unsigned int locked; // 1 while this process has to wait
+} __attribute__((aligned(64)));
+
+// Everything the processes share, mapped before the fork
+struct Lab {
+    unsigned int go; // Set when every process has been forked, they start together
+    unsigned int stop; // Set once [-d ms] is up
+    int procs;
+    long counter; // Only ever changed inside the critical section
+    struct Padded count[LAB_MAX]; // Acquisitions of each process
+    int em_flag[LAB_MAX]; // em: idle, want_in or in_cs
+    int em_turn;
+    int choosing[LAB_MAX]; // bakery
+    unsigned long number[LAB_MAX];
+    unsigned int ticket_next __attribute__((aligned(64))); // ticket
+    unsigned int ticket_serving __attribute__((aligned(64)));
+    unsigned int mcs_tail __attribute__((aligned(64))); // mcs: index + 1 of the last process in line, 0 if free
+    struct McsNode mcs[LAB_MAX];
+    unsigned int mutex __attribute__((aligned(64))); // futex
+    struct Qlock qlock; // qlock
+    pthread_mutex_t pmutex; // pthread
+    int semid; // sysv
+};
+
+// A lock under test: setup, then acquire/release by process i, and cleanup
+struct Lock {
+    const char* name;
+    void (*init)(struct Lab*);
+    void (*acquire)(struct Lab*, int);
+    void (*release)(struct Lab*, int);
+    void (*destroy)(struct Lab*);
+};
+
+enum em_state {em_idle, em_want_in, em_in_cs};
+
+// Seconds on the monotonic clock
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Seconds in a timeval from getrusage()
+double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// "iterations" steps of busy work the compiler can't drop, stands in for real work
+unsigned long work(unsigned long iterations, unsigned long x) {
+    for (unsigned long k = 0; k < iterations; k++) {
+        x = x * 6364136223846793005UL + 1442695040888963407UL;
+        __asm__ __volatile__("" : "+r"(x));
+    }
+    return x;
+}
+
+void nothing(struct Lab*) {
+}
+
+/* em: the same algorithm as enter_critical_section()/exit_critical_section() in palin.cpp,
+   with every load and store of the flags and the turn sequentially consistent. Raising a
+   flag and then reading the others needs that (a store-load fence) even on x86. */
+
+void em_init(struct Lab* lab) {
+    for (int i = 0; i < LAB_MAX; i++)
+        lab->em_flag[i] = em_idle;
+    lab->em_turn = 0;
+}
+
+void em_acquire(struct Lab* lab, int i) {
+    int n = lab->procs;
+    int j;
+    do {
+        __atomic_store_n(&lab->em_flag[i], em_want_in, __ATOMIC_SEQ_CST);
+        j = __atomic_load_n(&lab->em_turn, __ATOMIC_SEQ_CST);
+        while (j != i) { // Wait until everybody from the turn up to us is idle
+            if (__atomic_load_n(&lab->em_flag[j], __ATOMIC_SEQ_CST) != em_idle)
+                j = __atomic_load_n(&lab->em_turn, __ATOMIC_SEQ_CST);
+            else
+                j = (j + 1) % n;
+            cpu_relax();
+        }
+        __atomic_store_n(&lab->em_flag[i], em_in_cs, __ATOMIC_SEQ_CST);
+        for (j = 0; j < n; j++) { // Nobody else may be in_cs
+            if (j != i && __atomic_load_n(&lab->em_flag[j], __ATOMIC_SEQ_CST) == em_in_cs)
+                break;
+        }
+    } while (j < n || (__atomic_load_n(&lab->em_turn, __ATOMIC_SEQ_CST) != i &&
+                       __atomic_load_n(&lab->em_flag[__atomic_load_n(&lab->em_turn, __ATOMIC_SEQ_CST)], __ATOMIC_SEQ_CST) != em_idle));
+    __atomic_store_n(&lab->em_turn, i, __ATOMIC_SEQ_CST);
+}
+
+void em_release(struct Lab* lab, int i) {
+    int n = lab->procs;
+    int j = (__atomic_load_n(&lab->em_turn, __ATOMIC_SEQ_CST) + 1) % n;
+    while (__atomic_load_n(&lab->em_flag[j], __ATOMIC_SEQ_CST) == em_idle)
+        j = (j + 1) % n;
+    __atomic_store_n(&lab->em_turn, j, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&lab->em_flag[i], em_idle, __ATOMIC_SEQ_CST);
+}
+
+/* bakery: take a number one higher than any other, then wait for everyone holding a
+   smaller (number, index) pair */
+
+void bakery_init(struct Lab* lab) {
+    for (int i = 0; i < LAB_MAX; i++) {
+        lab->choosing[i] = 0;
+        lab->number[i] = 0;
+    }
+}
+
+void bakery_acquire(struct Lab* lab, int i) {
+    int n = lab->procs;
+    __atomic_store_n(&lab->choosing[i], 1, __ATOMIC_SEQ_CST);
+    unsigned long highest = 0;
+    for (int j = 0; j < n; j++) {
+        unsigned long number = __atomic_load_n(&lab->number[j], __ATOMIC_SEQ_CST);
+        if (number > highest)
+            highest = number;
+    }
+    __atomic_store_n(&lab->number[i], highest + 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&lab->choosing[i], 0, __ATOMIC_SEQ_CST);
+    for (int j = 0; j < n; j++) {
+        while (__atomic_load_n(&lab->choosing[j], __ATOMIC_SEQ_CST))
+            cpu_relax();
+        while (true) {
+            unsigned long number = __atomic_load_n(&lab->number[j], __ATOMIC_SEQ_CST);
+            if (number == 0 || number > highest + 1 || (number == highest + 1 && j >= i))
+                break;
+            cpu_relax();
+        }
+    }
+}
+
+void bakery_release(struct Lab* lab, int i) {
+    __atomic_store_n(&lab->number[i], 0, __ATOMIC_SEQ_CST);
+}
+
+/* ticket: take the next ticket, spin until it is served */
+
+void ticket_init(struct Lab* lab) {
+    lab->ticket_next = 0;
+    lab->ticket_serving = 0;
+}
+
+void ticket_acquire(struct Lab* lab, int) {
+    unsigned int ticket = __atomic_fetch_add(&lab->ticket_next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lab->ticket_serving, __ATOMIC_ACQUIRE) != ticket)
+        cpu_relax();
+}
+
+void ticket_release(struct Lab* lab, int) {
+    __atomic_store_n(&lab->ticket_serving, lab->ticket_serving + 1, __ATOMIC_RELEASE);
+}
+
+/* mcs: join the end of the queue with one exchange, then spin on our own node until the
+   process in front hands the lock over */
+
+void mcs_init(struct Lab* lab) {
+    lab->mcs_tail = 0;
+}
+
+void mcs_acquire(struct Lab* lab, int i) {
+    struct McsNode* node = &lab->mcs[i];
+    node->next = 0;
+    node->locked = 1;
+    unsigned int previous = __atomic_exchange_n(&lab->mcs_tail, i + 1, __ATOMIC_ACQ_REL);
+    if (previous == 0) // Nobody had it
+        return;
+    __atomic_store_n(&lab->mcs[previous - 1].next, i + 1, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+        cpu_relax();
+}
+
+void mcs_release(struct Lab* lab, int i) {
+    struct McsNode* node = &lab->mcs[i];
+    unsigned int next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (next == 0) {
+        unsigned int self = i + 1;
+        if (__atomic_compare_exchange_n(&lab->mcs_tail, &self, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return; // Nobody in line
+        while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == 0) // One is joining
+            cpu_relax();
+    }
+    __atomic_store_n(&lab->mcs[next - 1].locked, 0, __ATOMIC_RELEASE);
+}
+
+/* futex: 0 free, 1 taken, 2 taken and someone may be asleep. Releasing only makes a
+   system call when the lock was 2. */
+
+void futex_init(struct Lab* lab) {
+    lab->mutex = 0;
+}
+
+void futex_acquire(struct Lab* lab, int) {
+    unsigned int c = 0;
+    if (__atomic_compare_exchange_n(&lab->mutex, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    if (c != 2)
+        c = __atomic_exchange_n(&lab->mutex, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        futex_wait(&lab->mutex, 2);
+        c = __atomic_exchange_n(&lab->mutex, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void futex_release(struct Lab* lab, int) {
+    if (__atomic_fetch_sub(&lab->mutex, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(&lab->mutex, 0, __ATOMIC_RELEASE);
+        futex_wake(&lab->mutex, 1);
+    }
+}
+
+/* qlock: palin's lock */
+
+void qlock_lab_init(struct Lab* lab) {
+    qlock_init(&lab->qlock);
+}
+
+void qlock_lab_acquire(struct Lab* lab, int) {
+    qlock_acquire(&lab->qlock);
+}
+
+void qlock_lab_release(struct Lab* lab, int) {
+    qlock_release(&lab->qlock);
+}
+
+/* pthread: a process-shared mutex */
+
+void pthread_init(struct Lab* lab) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+        pthread_mutex_init(&lab->pmutex, &attr) != 0) {
+        perror("lockbench: Error: Cannot set up a process-shared pthread mutex");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+
+void pthread_acquire(struct Lab* lab, int) {
+    pthread_mutex_lock(&lab->pmutex);
+}
+
+void pthread_release(struct Lab* lab, int) {
+    pthread_mutex_unlock(&lab->pmutex);
+}
+
+void pthread_destroy(struct Lab* lab) {
+    pthread_mutex_destroy(&lab->pmutex);
+}
+
+/* sysv: a semaphore starting at 1 */
+
+void sysv_init(struct Lab* lab) {
+    lab->semid = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+    if (lab->semid == -1) {
+        perror("lockbench: semget: Error: Cannot create a semaphore");
+        exit(EXIT_FAILURE);
+    }
+    if (semctl(lab->semid, 0, SETVAL, 1) == -1) {
+        perror("lockbench: semctl: Error: Cannot set the semaphore");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void sysv_acquire(struct Lab* lab, int) {
+    struct sembuf down = {0, -1, 0};
+    while (semop(lab->semid, &down, 1) == -1) // Only EINTR can get us here
+        ;
+}
+
+void sysv_release(struct Lab* lab, int) {
+    struct sembuf up = {0, 1, 0};
+    semop(lab->semid, &up, 1);
+}
+
+void sysv_destroy(struct Lab* lab) {
+    semctl(lab->semid, 0, IPC_RMID);
+}
+
+struct Lock locks[] = {
+    {"em", em_init, em_acquire, em_release, nothing},
+    {"bakery", bakery_init, bakery_acquire, bakery_release, nothing},
+    {"ticket", ticket_init, ticket_acquire, ticket_release, nothing},
+    {"mcs", mcs_init, mcs_acquire, mcs_release, nothing},
+    {"futex", futex_init, futex_acquire, futex_release, nothing},
+    {"qlock", qlock_lab_init, qlock_lab_acquire, qlock_lab_release, nothing},
+    {"pthread", pthread_init, pthread_acquire, pthread_release, pthread_destroy},
+    {"sysv", sysv_init, sysv_acquire, sysv_release, sysv_destroy},
+};
+const int lock_count = sizeof(locks) / sizeof(locks[0]);
+
+// Child i: waits for the start, then takes the lock until told to stop
+void contend(struct Lab* lab, struct Lock* lock, int i, unsigned long inside, unsigned long outside) {
+    while (!__atomic_load_n(&lab->go, __ATOMIC_ACQUIRE))
+        futex_wait(&lab->go, 0);
+    unsigned long x = i;
+    unsigned long count = 0;
+    while (!__atomic_load_n(&lab->stop, __ATOMIC_RELAXED)) {
+        lock->acquire(lab, i);
+        long value = lab->counter; // Not atomic on purpose, a lost update means the lock failed
+        x = work(inside, x);
+        lab->counter = value + 1;
+        lock->release(lab, i);
+        count++;
+        __atomic_store_n(&lab->count[i].value, count, __ATOMIC_RELAXED);
+        x = work(outside, x);
+    }
+    _exit(x == 42 ? 1 : 0); // Uses x so the work can't be left out
+}
+
+// Splits "a,b,c" into its parts
+std::vector<std::string> split_list(const char* list) {
+    std::vector<std::string> parts;
+    std::string copy = list;
+    for (char* token = strtok(&copy[0], ","); token != NULL; token = strtok(NULL, ","))
+        parts.push_back(token);
+    return parts;
+}
+
+void usage() {
+    printf("Usage: ./lockbench [-l list] [-p list] [-d ms] [-c iterations] [-w iterations] [-o csv]\n");
+    printf("    [-l list] comma separated locks: em, bakery, ticket, mcs, futex, qlock, pthread, sysv (Default: all)\n");
+    printf("    [-p list] comma separated process counts, at most %d (Default: 2,4,8,16,32,64)\n", LAB_MAX);
+    printf("    [-d ms] how long every run takes the lock (Default: 500)\n");
+    printf("    [-c iterations] work inside the critical section (Default: 50)\n");
+    printf("    [-w iterations] work between acquisitions (Default: 200)\n");
+    printf("    [-o csv] also append the results to this file\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char* lock_list = NULL;
+    const char* proc_list = "2,4,8,16,32,64";
+    int duration_ms = 500;
+    unsigned long inside = 50, outside = 200;
+    const char* csv_name = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:p:d:c:w:o:h")) != -1) {
+        switch (opt) {
+            case 'l': lock_list = optarg; break;
+            case 'p': proc_list = optarg; break;
+            case 'd': duration_ms = atoi(optarg); break;
+            case 'c': inside = atol(optarg); break;
+            case 'w': outside = atol(optarg); break;
+            case 'o': csv_name = optarg; break;
+            case 'h': usage(); return 0;
+            default: usage(); return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<struct Lock*> chosen;
+    if (lock_list == NULL) {
+        for (int k = 0; k < lock_count; k++)
+            chosen.push_back(&locks[k]);
+    }
+    else {
+        std::vector<std::string> names = split_list(lock_list);
+        for (size_t n = 0; n < names.size(); n++) {
+            int k = 0;
+            while (k < lock_count && names[n] != locks[k].name)
+                k++;
+            if (k == lock_count) {
+                fprintf(stderr, "lockbench: Error: Unknown lock \"%s\"\n", names[n].c_str());
+                usage();
+                return EXIT_FAILURE;
+            }
+            chosen.push_back(&locks[k]);
+        }
+    }
+    std::vector<int> procs;
+    std::vector<std::string> counts = split_list(proc_list);
+    for (size_t n = 0; n < counts.size(); n++) {
+        procs.push_back(atoi(counts[n].c_str()));
+        if (procs.back() < 1 || procs.back() > LAB_MAX) {
+            fprintf(stderr, "lockbench: Error: Process counts have to be between 1 and %d\n", LAB_MAX);
+            return EXIT_FAILURE;
+        }
+    }
+    if (duration_ms < 1) {
+        fprintf(stderr, "lockbench: Error: [-d ms] has to be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    // What the critical section and the work between acquisitions cost without any lock
+    double start = now();
+    unsigned long calibrate = work(20000000, 1);
+    double ns_per_step = (now() - start) * 1e9 / 20000000;
+    printf("%.2f ns per work step (%lu), %lu steps inside, %lu outside, %ld CPUs online\n\n",
+           ns_per_step, calibrate & 1, inside, outside, sysconf(_SC_NPROCESSORS_ONLN));
+
+    struct Lab* lab = (struct Lab*) mmap(NULL, sizeof(struct Lab), PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (lab == MAP_FAILED) {
+        perror("lockbench: mmap: Error: Cannot map shared memory");
+        return EXIT_FAILURE;
+    }
+    FILE* csv = NULL;
+    if (csv_name != NULL) {
+        bool header = access(csv_name, F_OK) != 0;
+        csv = fopen(csv_name, "a");
+        if (csv == NULL) {
+            perror("lockbench: Error: Cannot open the csv file for output");
+            return EXIT_FAILURE;
+        }
+        if (header)
+            fprintf(csv, "lock,procs,acquisitions,wall_s,acq_per_s,fairness,cpu_s,wait_cpu_s,wait_cpu_per_acq_us,status\n");
+    }
+
+    printf("%-8s %5s %12s %12s %9s %9s %11s %14s\n", "lock", "procs", "acquisitions", "acq/s",
+           "fairness", "cpu_s", "wait_cpu_s", "wait_us/acq");
+    for (size_t l = 0; l < chosen.size(); l++) {
+        struct Lock* lock = chosen[l];
+        for (size_t p = 0; p < procs.size(); p++) {
+            memset(lab, 0, sizeof(struct Lab));
+            lab->procs = procs[p];
+            lock->init(lab);
+
+            struct rusage before, after;
+            getrusage(RUSAGE_CHILDREN, &before);
+            std::vector<pid_t> children;
+            for (int i = 0; i < procs[p]; i++) {
+                pid_t pid = fork();
+                if (pid == -1) {
+                    perror("lockbench: fork: Error: Cannot start a process");
+                    exit(EXIT_FAILURE);
+                }
+                if (pid == 0)
+                    contend(lab, lock, i, inside, outside);
+                children.push_back(pid);
+            }
+            double begin = now();
+            __atomic_store_n(&lab->go, 1, __ATOMIC_RELEASE);
+            futex_wake(&lab->go, INT_MAX);
+            usleep(duration_ms * 1000);
+            __atomic_store_n(&lab->stop, 1, __ATOMIC_RELEASE);
+
+            // Wait for them to see the stop, killing whoever takes far too long
+            double deadline = now() + duration_ms * 10 / 1000.0 + 5;
+            size_t left = children.size();
+            bool killed = false;
+            while (left > 0) {
+                pid_t pid = waitpid(-1, NULL, WNOHANG);
+                if (pid > 0) {
+                    left--;
+                    continue;
+                }
+                if (!killed && now() > deadline) {
+                    for (size_t c = 0; c < children.size(); c++)
+                        kill(children[c], SIGKILL);
+                    killed = true;
+                }
+                usleep(1000);
+            }
+            double wall = now() - begin;
+            getrusage(RUSAGE_CHILDREN, &after);
+            lock->destroy(lab);
+
+            unsigned long total = 0, most = 0, fewest = ~0UL;
+            for (int i = 0; i < procs[p]; i++) {
+                unsigned long count = lab->count[i].value;
+                total += count;
+                if (count > most)
+                    most = count;
+                if (count < fewest)
+                    fewest = count;
+            }
+            double cpu = seconds(after.ru_utime) - seconds(before.ru_utime) +
+                         seconds(after.ru_stime) - seconds(before.ru_stime);
+            double useful = total * (inside + outside) * ns_per_step / 1e9;
+            double waiting = (cpu > useful) ? cpu - useful : 0;
+            const char* status = killed ? "TIMEOUT" : ((unsigned long) lab->counter != total) ? "BROKEN" : "ok";
+            char fairness[16];
+            if (fewest == 0)
+                snprintf(fairness, sizeof(fairness), "starved");
+            else
+                snprintf(fairness, sizeof(fairness), "%.2f", (double) most / fewest);
+
+            printf("%-8s %5d %12lu %12.0f %9s %9.3f %11.3f %14.3f %s\n", lock->name, procs[p], total,
+                   total / wall, fairness, cpu, waiting, total ? waiting * 1e6 / total : 0.0,
+                   (strcmp(status, "ok") == 0) ? "" : status);
+            fflush(stdout);
+            if (csv != NULL) {
+                fprintf(csv, "%s,%d,%lu,%.6f,%.1f,%s,%.6f,%.6f,%.3f,%s\n", lock->name, procs[p], total, wall,
+                        total / wall, fairness, cpu, waiting, total ? waiting * 1e6 / total : 0.0, status);
+                fflush(csv);
+            }
+        }
+    }
+    if (csv != NULL)
+        fclose(csv);
+    munmap(lab, sizeof(struct Lab));
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: logring.cpp
+    Purpose:
+     A ring of fixed-size log records in shared memory. Every palin pushes the result for
+     its word into the ring instead of opening, appending to and closing the out-files and
+     the log file itself, and master is the only process that takes records out and writes
+     them, in big buffered writes.
+
+     Pushing doesn't take a lock: a palin reserves as many records as its word needs with a
+     single atomic add on head, fills them in and marks each one written through its seq
+     number. Master reads records in order from tail and hands each one back by moving its
+     seq number a full lap ahead. When the ring is full a palin sleeps on the record it is
+     waiting for, and when it is empty master sleeps on the next record, both on a futex.
+
+     A palin killed between reserving its records and publishing them leaves a hole that is
+     never filled in. Once every palin is gone master skips such holes (logring_skip()) and
+     goes on with the entries after them, instead of waiting for them forever.
+
+*/
+
+#include <string.h>
+#include "futex.h"
+#include "logring.h"
+
+// Sets up an empty ring, every record is free for the position it will hold first
+void logring_init(struct LogRing* ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->writers_waiting = 0;
+    ring->reader_waiting = 0;
+    for (unsigned int i = 0; i < LOG_SLOTS; i++) {
+        ring->rec[i].seq = i;
+    }
+}
+
+// Pushes the result for a word. Returns false (and pushes nothing) if the word is too long
+// to fit in LOG_MAX_RECORDS records, the caller has to write it out itself.
+bool logring_push(struct LogRing* ring, int kind, long index, int pid, long stamp, const char* text, int length) {
+    int records = (length + LOG_TEXT - 1) / LOG_TEXT;
+    if (records == 0) // An empty line still needs a record
+        records = 1;
+    if (records > LOG_MAX_RECORDS)
+        return false;
+
+    unsigned int pos = __atomic_fetch_add(&ring->head, records, __ATOMIC_RELAXED);
+    for (int k = 0; k < records; k++) {
+        struct LogRecord* rec = &ring->rec[(pos + k) % LOG_SLOTS];
+        seq_wait(&rec->seq, pos + k, &ring->writers_waiting, -1); // Wait for master to free it
+        int chunk = length - k * LOG_TEXT;
+        if (chunk > LOG_TEXT)
+            chunk = LOG_TEXT;
+        rec->kind = kind;
+        rec->records = records;
+        rec->pid = pid;
+        rec->index = index;
+        rec->stamp = stamp;
+        rec->length = length;
+        memcpy(rec->text, text + k * LOG_TEXT, chunk);
+        seq_publish(&rec->seq, pos + k + 1, &ring->reader_waiting);
+    }
+    return true;
+}
+
+// Master: waits up to timeout_ms for the next entry. Returns how many records it is made of
+// (read them with logring_record() and hand them back with logring_release()), or 0 if
+// nothing arrived in time.
+int logring_wait(struct LogRing* ring, int timeout_ms) {
+    unsigned int tail = ring->tail;
+    struct LogRecord* first = &ring->rec[tail % LOG_SLOTS];
+    if (!seq_wait(&first->seq, tail + 1, &ring->reader_waiting, timeout_ms))
+        return 0;
+    int records = first->records;
+    for (int k = 1; k < records; k++) { // The palin may still be filling in the rest
+        if (!seq_wait(&ring->rec[(tail + k) % LOG_SLOTS].seq, tail + k + 1, &ring->reader_waiting, timeout_ms))
+            return 0; // Not complete yet, try again later
+    }
+    return records;
+}
+
+// Master: record k of the entry logring_wait() returned
+struct LogRecord* logring_record(struct LogRing* ring, int k) {
+    return &ring->rec[(ring->tail + k) % LOG_SLOTS];
+}
+
+// Master: hands the records of the current entry back to the palins
+void logring_release(struct LogRing* ring, int records) {
+    unsigned int tail = ring->tail;
+    for (int k = 0; k < records; k++) {
+        seq_publish(&ring->rec[(tail + k) % LOG_SLOTS].seq, tail + k + LOG_SLOTS, &ring->writers_waiting);
+    }
+    ring->tail = tail + records;
+}
+
+// Master, once no palin can push any more: hands back the records of every entry at tail
+// that will never be complete, without reading them or waiting, until tail is at a complete
+// entry or the ring is empty. Returns how many records were skipped.
+int logring_skip(struct LogRing* ring) {
+    int skipped = 0;
+    while (true) {
+        unsigned int tail = ring->tail;
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+            return skipped;
+        int records = 1; // Nothing of it was published, the record after it may start another entry
+        struct LogRecord* first = &ring->rec[tail % LOG_SLOTS];
+        if (__atomic_load_n(&first->seq, __ATOMIC_ACQUIRE) == tail + 1) { // Its first record made it
+            records = first->records;
+            int k = 1;
+            while (k < records && __atomic_load_n(&ring->rec[(tail + k) % LOG_SLOTS].seq, __ATOMIC_ACQUIRE) == tail + k + 1)
+                k++;
+            if (k == records) // All of it, logring_wait() hands it out
+                return skipped;
+        }
+        logring_release(ring, records);
+        skipped += records;
+    }
+}
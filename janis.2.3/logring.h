@@ -0,0 +1,46 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: logring.h
+*/
+
+#define LOG_SLOTS 4096 // Records in the ring, a power of two
+#define LOG_TEXT 88 // Bytes of the word carried by each record
+#define LOG_MAX_RECORDS (LOG_SLOTS / 2) // Longest entry the ring takes, longer words are written directly
+
+enum log_kind {log_palin, log_nopalin, log_analysis}; // Which out-file the entry goes to
+
+// One fixed-size record. A word longer than LOG_TEXT is carried by several records in a row,
+// the first one holds the details and the ones after it only hold more of the text.
+struct LogRecord {
+    unsigned int seq; // == position while free for that position, position+1 once written
+    int kind; // log_palin or log_nopalin
+    int records; // Number of records in this entry
+    int pid; // PID of the palin that checked the word
+    long index; // Index of the word in the infile
+    long stamp; // time() when palin logged it
+    int length; // Length of the whole word
+    char text[LOG_TEXT]; // Up to LOG_TEXT bytes of the word
+} __attribute__((aligned(64)));
+
+// Many palins push, master is the only one that reads
+struct LogRing {
+    unsigned int head __attribute__((aligned(64))); // Next position handed to a palin
+    unsigned int writers_waiting; // palins asleep because the ring is full
+    unsigned int tail __attribute__((aligned(64))); // Next position master reads
+    unsigned int reader_waiting; // 1 while master is asleep because the ring is empty
+    struct LogRecord rec[LOG_SLOTS];
+};
+
+void logring_init(struct LogRing*);
+bool logring_push(struct LogRing*, int, long, int, long, const char*, int);
+int logring_wait(struct LogRing*, int);
+struct LogRecord* logring_record(struct LogRing*, int);
+void logring_release(struct LogRing*, int);
+int logring_skip(struct LogRing*);
+
+#endif
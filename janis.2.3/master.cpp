@@ -17,23 +17,73 @@
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <thread>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "master.h"
 #include "shared.h"
+#include "kernel.h"
+#include "futex.h"
+#include "uring.h"
 
 int pr_limit = 4; // max total of child processes master will ever create [-n x] (Default: 4)
 int ch_limit = 2; // number of children allowed to exist in the system at the same time [-s x] (Default: 2)
 int timer = 100; // time in seconds after which the process will terminate, even if it has not finished [-t time] (Default: 100)
 int pr_count = 0; // Current running total of children processes present
+bool pool = false; // pre-fork a pool of palin workers that pull words from shared memory [-p] (Default: off)
+bool split = false; // every worker checks the lines starting in its share of the infile's bytes [-r] (Default: off)
+bool stream = false; // infile "-": read the words from stdin while the pool checks them (Default: off)
+bool threaded = false; // check the words on [-s x] threads inside master, no palin processes at all [-T] (Default: off)
+int lock = lock_futex; // how palin guards its critical section [-l lock] (Default: futex)
+std::string stats_file; // file the run's word count and latency percentiles are appended to [-b file] (Default: none)
+unsigned long dedup_slots = 0; // entries in the shared verdict cache for repeated words [-c slots] (Default: 0, off)
+unsigned long palindrome_slots = 0; // [-a corpus] size of the set of palindromes seen, from the infile size
+int analysis = analysis_none; // what palin reports about each line instead of a verdict [-a mode] (Default: none)
+bool utf8 = false; // the words are UTF-8, palin compares case-folded code points instead of bytes [-u] (Default: off)
+bool ordered = false; // no critical section, master prints the results in input order at the end [--ordered] (Default: off)
 
 struct Shmem* shmem; // struct instance used for shared memory
+char* fmap = NULL; // The infile, mapped read-only into memory
+size_t fsize = 0; // Size of the infile (and of the mapping) in bytes
+
+pthread_t drain_thread; // Thread writing out the results palin pushes into the log ring
+int drain_running = 0; // 1 while drain_thread is running
+int drain_stop = 0; // Set once every child has exited, drain_thread finishes what is left and stops
+long drain_skipped = 0; // Log records reserved by a palin that was killed before it published them
+struct OutFile palin_out, nopalin_out, log_out; // palin.out, nopalin.out and output.log
+struct OutFile analysis_out; // lps.out or distinct.out in [-a mode]
+struct Uring uring; // Writes the output files in the background, fd is -1 if the kernel can't (set in main)
+bool uring_tried = false; // uring_init() was called, it is only tried once
+long out_bytes = 0; // Bytes written to the output files
+long out_calls = 0; // System calls it took to write them
+
+pthread_t clock_thread; // Thread keeping shmem->clock up to date
+int clock_running = 0; // 1 while clock_thread is running
+unsigned int clock_stop = 0; // Set (and futex-woken) to stop clock_thread
+volatile sig_atomic_t stats_wanted = 0; // Set by SIGUSR1, clock_thread prints the worker stats
+volatile sig_atomic_t interrupted = 0; // SIGINT or SIGALRM once CTRL+C or [-t time] stopped the run, main shuts it down
 
 key_t skey; // Unique key for using shared memory
 int sid; // Shared memory segment ID
 
 int main(int argc, char *argv[]) {
 
+    uring.fd = -1; // Not set up until the first output file is opened (uring_init())
+
     // Checks for interrupt from keyboard, if found, calls sig_handle()
-    signal(SIGINT, sig_handle);
+    struct sigaction interrupt;
+    sigemptyset(&interrupt.sa_mask);
+    interrupt.sa_handler = &sig_handle;
+    interrupt.sa_flags = 0; // Not restarted: wait() and reading stdin come back, so main sees the flag
+    sigaction(SIGINT, &interrupt, NULL);
+    signal(SIGUSR1, sig_stats); // Prints the worker stats of the run so far
 
     int word_count = 0; // stores the total # of words in the file passed in
 
@@ -54,7 +104,12 @@ int main(int argc, char *argv[]) {
 
     // This while loop + switch statement allows for the checking of parse options
     int opt;
-    while ((opt = getopt(argc, argv, "n:s:t:h")) != -1) {
+    static struct option long_options[] = {
+        {"ordered", no_argument, NULL, 'o'},
+        {"utf8", no_argument, NULL, 'u'},
+        {NULL, 0, NULL, 0}
+    };
+    while ((opt = getopt_long(argc, argv, "n:s:t:pTrl:ob:c:a:uh", long_options, NULL)) != -1) {
         switch (opt) {
             case 'n':
                 // Number of max total child processes allowed by master
@@ -81,6 +136,64 @@ int main(int argc, char *argv[]) {
                     errors(exe_name.c_str(), error_msg.c_str());
                 }
                 break;
+            case 'p': // Start [-s x] long-lived palin workers once, instead of one palin per word
+                pool = true;
+                break;
+            case 'r': // Give every pool worker a byte range of the infile, master doesn't look for the lines
+                split = true;
+                pool = true;
+                break;
+            case 'T': // Check the words on threads in master instead of forking palin processes
+                threaded = true;
+                break;
+            case 'l': // Which mutual exclusion palin uses for its critical section
+                if (strcmp(optarg, "futex") == 0) {
+                    lock = lock_futex;
+                }
+                else if (strcmp(optarg, "em") == 0) {
+                    lock = lock_em;
+                }
+                else {
+                    error_msg = "[-l lock] value should be either futex or em.";
+                    errors(exe_name.c_str(), error_msg.c_str());
+                }
+                break;
+            case 'c': // Cache the verdicts of the words, rounded up to a power of two entries
+                if (atol(optarg) < 0) {
+                    error_msg = "[-c slots] value should be 0 (off) or positive.";
+                    errors(exe_name.c_str(), error_msg.c_str());
+                }
+                dedup_slots = 0;
+                if (atol(optarg) > 0) {
+                    dedup_slots = 1;
+                    while (dedup_slots < (unsigned long) atol(optarg))
+                        dedup_slots <<= 1;
+                }
+                break;
+            case 'a': // Analysis mode, palin reports on every line instead of checking it
+                if (strcmp(optarg, "lps") == 0) {
+                    analysis = analysis_lps;
+                }
+                else if (strcmp(optarg, "distinct") == 0) {
+                    analysis = analysis_distinct;
+                }
+                else if (strcmp(optarg, "corpus") == 0) {
+                    analysis = analysis_corpus;
+                }
+                else {
+                    error_msg = "[-a mode] value should be lps, distinct or corpus.";
+                    errors(exe_name.c_str(), error_msg.c_str());
+                }
+                break;
+            case 'u': // UTF-8 words: code points, Unicode case folding, punctuation/symbol/space categories skipped
+                utf8 = true;
+                break;
+            case 'b': // For bench: append the number of words checked and the latency percentiles to a file
+                stats_file = optarg;
+                break;
+            case 'o': // palin skips the critical section and leaves its result in a slot per word
+                ordered = true;
+                break;
             case 'h': // -h will describe how the project should be run and then terminate
             default:
                 usage(exe_name.c_str());
@@ -88,6 +201,42 @@ int main(int argc, char *argv[]) {
     }
     printf("\n______________________\n");
     printf("\n process limit: %d\n   child limit: %d\n         timer: %d\n", pr_limit, ch_limit, timer);
+    if (analysis != analysis_none && (threaded || ordered)) {
+        error_msg = "[-a mode] doesn't work with [-T] or [--ordered], its results go through the log.";
+        errors(exe_name.c_str(), error_msg.c_str());
+    }
+    if (split && (threaded || ordered)) {
+        error_msg = "[-r] doesn't work with [-T] or [--ordered], the lines aren't counted up front.";
+        errors(exe_name.c_str(), error_msg.c_str());
+    }
+    if (threaded) {
+        printf("          mode: threads\n");
+        ordered = true; // The threads only fill in the result slots, there is no critical section
+    }
+    else if (split) {
+        printf("          mode: worker pool, byte ranges\n");
+    }
+    else if (pool) {
+        printf("          mode: worker pool\n");
+    }
+    if (analysis == analysis_lps) {
+        printf("      analysis: longest palindromic substring\n");
+    }
+    else if (analysis == analysis_distinct) {
+        printf("      analysis: distinct palindromes per line\n");
+    }
+    else if (analysis == analysis_corpus) {
+        printf("      analysis: distinct palindromes per line and in the whole input\n");
+    }
+    if (utf8) {
+        printf("         input: UTF-8\n");
+    }
+    if (ordered) {
+        printf("        output: in input order\n");
+    }
+    else {
+        printf("          lock: %s\n", (lock == lock_futex) ? "futex" : "em");
+    }
     printf("______________________\n\n");
     if (argv[optind] == NULL) { // Checks that there was a file provided, otherwise terminates
         error_msg = "There was no file provided, terminating.";
@@ -95,6 +244,15 @@ int main(int argc, char *argv[]) {
     }
     
     infile = argv[optind]; // Store the file name with the palindromes to test
+    if (infile == "-") { // Stream the words from stdin, only pool workers can take them from the line ring
+        if (threaded || ordered || split) {
+            error_msg = "Reading the words from stdin (infile -) doesn't work with [-T], [-r] or [--ordered].";
+            errors(exe_name.c_str(), error_msg.c_str());
+        }
+        stream = true;
+        pool = true;
+        printf("         input: stdin, through a pool of workers\n\n");
+    }
     //printf("palindrome file: %s\n\n", infile.c_str());
     
     int count = 0;
@@ -108,52 +266,101 @@ int main(int argc, char *argv[]) {
     }
 
     // Generate a (key_t) type System V IPC key for use with shared memory
-    if ((skey = ftok("makefile", 'a')) == (key_t) -1) {
+    if (!threaded && (skey = ftok("makefile", 'a')) == (key_t) -1) {
         error_msg = exe_name + ": ftok : Error: there was an error creating a shared memory key (returned -1)"; 
         perror(error_msg.c_str());
         exit(EXIT_FAILURE);
     }
 
-    // Tries to allocate a shared memory segment, otherwise it will use the 
-    // previously allocated shared memory segment
-    if ((sid = shmget(skey, sizeof(struct Shmem), IPC_CREAT | 0666)) < 0) { 
-        // if the sid is < 0, it couldn't allocate a shared memory segment
-        error_msg = exe_name + ": shmget: Error: An error occurred while trying to allocate a valid shared memory segment";
-        perror(error_msg.c_str());
-        exit(EXIT_FAILURE);
+    if (stream) { // The words arrive later through the line ring, the segment only needs the header
+        word_count = 0;
     }
     else {
-        shmem = (struct Shmem*) shmat(sid, NULL, 0); 
-        // attaches to Sys V shared mem segment using previously allocated memory segment (sid)
-        // Since shmaddr is NULL, system chooses a suitable (unused) page-aligned address to attach the segment
+        // Map the infile read-only, the words are read straight out of the page cache from here on
+        int fd = open(infile.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            error_msg = exe_name + ": Error: Cannot open infile for reading, terminating";
+            perror(error_msg.c_str());
+            exit(EXIT_FAILURE);
+        }
+        fsize = st.st_size;
+        if (fsize > 0) { // mmap() refuses a length of 0, an empty infile simply has no words
+            fmap = (char*) mmap(NULL, fsize, PROT_READ, MAP_SHARED, fd, 0);
+            if (fmap == MAP_FAILED) {
+                error_msg = exe_name + ": mmap: Error: Cannot map the infile into memory, terminating";
+                perror(error_msg.c_str());
+                exit(EXIT_FAILURE);
+            }
+            madvise(fmap, fsize, MADV_SEQUENTIAL); // The scans below read it front to back
+        }
+        close(fd); // The mapping stays valid after the descriptor is closed
+
+        // First scan: count the words so the segment can be sized for their offsets
+        // ([-r] skips both scans, the workers find the lines in their own byte ranges)
+        word_count = split ? 0 : scan_lines(fmap, fsize, NULL);
     }
-    
-    // Counts down a preset random timer until 0, then sends interrupt signal
-    countdown_to_interrupt(timer, exe_name.c_str()); 
-   
-    char temp[MAX_CANON]; // Temp storage for the line being read from infile 
 
-    FILE *fptr;
-    fptr = fopen(infile.c_str(), "r");
-    if (fptr == NULL) {
-        error_msg = exe_name + ": Error: Cannot open infile for reading, terminating";
-        perror(error_msg.c_str());
-        exit(EXIT_FAILURE);
+    if (analysis == analysis_corpus) {
+        // The infile can't hold more distinct palindromes than bytes, twice that keeps the set
+        // at most half full (up to 16M entries, 128MB). From stdin the size isn't known.
+        unsigned long wanted = stream ? (1UL << 24) : 2 * fsize;
+        palindrome_slots = 1024;
+        while (palindrome_slots < wanted && palindrome_slots < (1UL << 24))
+            palindrome_slots <<= 1;
+    }
+
+    if (threaded) { // Nothing is shared with other processes, the same layout lives on the heap
+        void* table;
+        if (posix_memalign(&table, 64, shmem_size(word_count, dedup_slots, palindrome_slots)) != 0) {
+            error_msg = exe_name + ": Error: Cannot allocate memory for the word table";
+            perror(error_msg.c_str());
+            exit(EXIT_FAILURE);
+        }
+        memset(table, 0, shmem_size(word_count, dedup_slots, palindrome_slots));
+        shmem = (struct Shmem*) table;
     }
     else {
-        while(!feof(fptr)) { // while not at the end of file,
-            if (fgets(temp, MAX_CANON, fptr) == NULL) // Grab a mew word (if it isn't NULL)
-                break; // Break if the line is NULL
-            strcpy(shmem->words[word_count], temp); // Copies the word to the shared memory struct
-            word_count++; // Increment word_count
+        // A segment left behind by an earlier run may be too small for this infile, so remove it first
+        if ((sid = shmget(skey, 0, 0)) != -1) {
+            shmctl(sid, IPC_RMID, NULL);
+        }
+
+        // Allocates a shared memory segment sized for the header plus the word offsets
+        if ((sid = shmget(skey, shmem_size(word_count, dedup_slots, palindrome_slots), IPC_CREAT | 0666)) < 0) { 
+            // if the sid is < 0, it couldn't allocate a shared memory segment
+            error_msg = exe_name + ": shmget: Error: An error occurred while trying to allocate a valid shared memory segment";
+            perror(error_msg.c_str());
+            exit(EXIT_FAILURE);
         }
-        fclose(fptr);
+        else {
+            shmem = (struct Shmem*) shmat(sid, NULL, 0); 
+            // attaches to Sys V shared mem segment using previously allocated memory segment (sid)
+            // Since shmaddr is NULL, system chooses a suitable (unused) page-aligned address to attach the segment
+        }
+    }
+    shmem->word_total = word_count;
+    shmem->file_size = fsize;
+    shmem->infile[0] = '\0';
+    if (!stream && realpath(infile.c_str(), shmem->infile) == NULL) { // palin may resolve relative paths differently
+        error_msg = exe_name + ": realpath: Error: Cannot resolve the infile path, terminating";
+        perror(error_msg.c_str());
+        free_memory();
+        exit(EXIT_FAILURE);
+    }
+    
+    // Counts down a preset random timer until 0, then sends interrupt signal
+    countdown_to_interrupt(timer, exe_name.c_str()); 
+
+    // Second scan: publish where every word starts, nothing else gets copied
+    if (!split) {
+        scan_lines(fmap, fsize, shmem_offsets(shmem));
     }
     
     int running_procs = 0; // Keeps track of the total amount of processes
 
     // Sets a cap on the process limit equal to the word count (there can't be more processes than words)
-    if (word_count < pr_limit) {
+    if (!stream && !split && word_count < pr_limit) {
         pr_limit = word_count; // (the process limit cannot be bigger than the word count)
     }
     // Number of children allowed to exist cannot be greater than the max of child processes EVER created
@@ -161,6 +368,95 @@ int main(int argc, char *argv[]) {
         ch_limit = pr_limit; // (there can't be more children in the system than the pr_limit allows)
     }
     
+    // Reset the critical section state left over from a previous run
+    shmem->lock = lock;
+    shmem->turn = 0;
+    for (int i = 0; i < PROC_LIMIT; i++) {
+        shmem->flag[i] = idle;
+    }
+    qlock_init(&shmem->cs_lock);
+    logring_init(&shmem->log);
+    linering_init(&shmem->lines);
+
+    // Start the clock (it also answers SIGUSR1) and start writing out results before the
+    // first child can push one
+    memset(shmem->stats, 0, sizeof(shmem->stats));
+    start_clock(exe_name.c_str());
+    start_drain(exe_name.c_str());
+
+    // Publish the work queue, pool workers claim words from next_word until word_total
+    shmem->pool = pool;
+    shmem->ordered = ordered;
+    shmem->stream = stream;
+    shmem->split = split;
+    shmem->analysis = analysis;
+    shmem->utf8 = utf8;
+    for (int i = 0; i < PROC_LIMIT; i++) {
+        shmem->range_words[i] = 0;
+        shmem->range_palins[i] = 0;
+    }
+    memset(shmem_results(shmem), 0, word_count); // Every word starts out unchecked
+    shmem->dedup_slots = dedup_slots;
+    shmem->dedup_hits = 0;
+    shmem->dedup_misses = 0;
+    memset(shmem_dedup(shmem), 0, dedup_slots * sizeof(struct DedupEntry)); // The cache starts out empty
+    shmem->palindrome_slots = palindrome_slots;
+    shmem->corpus_distinct = 0;
+    shmem->corpus_full = 0;
+    memset(shmem_palindromes(shmem), 0, palindrome_slots * sizeof(unsigned long));
+    shmem->next_word = 0;
+
+    if (threaded) {
+        run_threads(ch_limit);
+        if (interrupted) { // There are no children to kill, the threads stopped at their next word
+            report_interrupt(); // and the words they finished get written out like any other run
+        }
+        stop_drain();
+        stop_clock();
+        print_ordered(exe_name.c_str());
+        print_stats();
+        print_dedup();
+        print_output();
+        write_stats(exe_name.c_str());
+        free_memory();
+        return 0;
+    }
+
+    if (pool) {
+        // Every pool worker takes part in the critical section, so n is the number of workers
+        shmem->n = ch_limit;
+        // Fork the whole pool up front, the workers drain the queue and exit on their own
+        while (running_procs < ch_limit) {
+            running_procs++;
+            try_spawn(running_procs, exe_name.c_str());
+        }
+        if (stream) { // The workers are already waiting for the first line
+            read_stdin();
+        }
+        while (pr_count > 0) {
+            if (wait(NULL) == -1 && errno == EINTR) // A signal, not a child
+                continue;
+            --pr_count;
+        }
+        if (interrupted) {
+            finish_interrupted(exe_name.c_str());
+        }
+        stop_drain(); // Writes out the last results
+        stop_clock();
+        if (ordered) {
+            print_ordered(exe_name.c_str());
+        }
+        if (split) {
+            print_ranges();
+        }
+        print_stats();
+        print_dedup();
+        print_output();
+        write_stats(exe_name.c_str());
+        free_memory();
+        return 0;
+    }
+
     // Pass the process limit to shared memory
     shmem->n = pr_limit; 
 
@@ -173,19 +469,35 @@ int main(int argc, char *argv[]) {
 
     // Wait for all processes to finish, keep trying to spawn new children
     while (pr_count > 0) { // While there are currently children processes present,
-        wait(NULL); // wait for them to finish
+        if (wait(NULL) == -1 && errno == EINTR) // wait for them to finish (a signal isn't a child)
+            continue;
         --pr_count; // Decrement the number of current children processes present
         // Try to spawn another child
         running_procs++;
         try_spawn(running_procs, exe_name.c_str()); // Try to spawn children processes 
     }
+    if (interrupted) {
+        finish_interrupted(exe_name.c_str());
+    }
 
+    stop_drain(); // Writes out the last results
+    stop_clock();
+    if (ordered) {
+        print_ordered(exe_name.c_str());
+    }
+    print_stats();
+    print_dedup();
+    print_output();
+    write_stats(exe_name.c_str());
     free_memory(); // Clears all shared memory
     return 0;
 }
 
 void try_spawn(int running_procs, std::string exe_name) {
     std::string error_msg;
+    if (interrupted) { // The children are being killed, don't start new ones
+        return;
+    }
     // If the number of running processes is less than or equal to the number of 
     // max child processes master will ever create, AND there are currently less children 
     // processes running than the ch_limit (Max number of child processes master will ever create)
@@ -207,20 +519,600 @@ void try_spawn(int running_procs, std::string exe_name) {
     }
 }
 
-// Kills all child processes and terminates, and prints a log to log file and frees shared memory
+// [-T] mode: starts "threads" threads that claim words from next_word and check them, the
+// same way pool workers do but inside master, then waits for all of them to finish
+void run_threads(int threads) {
+    palin_kernel_init(); // Picks the fastest palindrome kernel this CPU supports
+    std::vector<std::thread> workers;
+    sigset_t old;
+    block_signals(&old); // The workers only look at the flag, main takes the signals
+    for (int slot = 0; slot < threads; slot++) {
+        shmem->worker_pid[slot] = getpid(); // Every thread logs master's PID
+        workers.push_back(std::thread(check_words, slot));
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+// [-T] worker thread: checks words until the queue is drained, leaving each result in the
+// word's slot like palin does in [--ordered] mode
+void check_words(int slot) {
+    unsigned char* results = shmem_results(shmem);
+    int next;
+    while (!interrupted && (next = __sync_fetch_and_add(&shmem->next_word, 1)) < shmem->word_total) {
+        unsigned long start = now_ns();
+        int length = shmem_length(shmem, next);
+        bool is_palin = shmem_check(shmem, shmem_word(shmem, fmap, next), length);
+        unsigned char result = RESULT_DONE | (is_palin ? RESULT_PALIN : 0) | slot;
+        __atomic_store_n(&results[next], result, __ATOMIC_RELEASE);
+        unsigned long took = now_ns() - start;
+        latency_add(shmem->latency, took);
+        struct WorkerStats* stats = &shmem->stats[slot]; // No critical section, only the check
+        stats_add(&stats->check_ns, took);
+        stats_add(&stats->words, 1);
+        stats_add(&stats->bytes, length);
+        if (is_palin)
+            stats_add(&stats->palins, 1);
+    }
+}
+
+// Infile "-": reads stdin a line at a time and puts every line into the line ring for the
+// pool, until end of file. linering_put() sleeps while the ring is full, so master stops
+// reading until the workers catch up and memory use stays the same however long the input is.
+void read_stdin() {
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    long index = 0;
+    while (!interrupted && (length = getline(&line, &capacity, stdin)) != -1) { // A signal ends it too
+        if (length > 0 && line[length-1] == '\n') // The newline isn't part of the word
+            length--;
+        if (!linering_put(&shmem->lines, index++, line, length))
+            break; // Interrupted while the ring was full, the workers are gone
+    }
+    free(line);
+    linering_close(&shmem->lines); // Workers exit once the ring is empty
+}
+
+// Finds every newline in the mapped infile and returns the number of words (lines) in it.
+// If offsets isn't NULL, the start of every word is stored in it, followed by one extra
+// offset where the word after the last one would start (see shmem_offsets() in shared.h).
+int scan_lines(const char* map, size_t size, size_t* offsets) {
+    int words = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    // Compare 16 bytes at a time against '\n', the mask has one bit set per newline found
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (map + i));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (offsets == NULL) { // Counting only, no need to find where the newlines are
+            words += __builtin_popcount(mask);
+            continue;
+        }
+        while (mask != 0) { // The next word starts right after each newline
+            offsets[++words] = i + __builtin_ctz(mask) + 1;
+            mask &= mask - 1; // Clear the lowest set bit
+        }
+    }
+#endif
+    for (; i < size; i++) { // Whatever is left over (or everything, without SSE2)
+        if (map[i] == '\n') {
+            words++;
+            if (offsets != NULL)
+                offsets[words] = i + 1;
+        }
+    }
+    if (size > 0 && map[size-1] != '\n') { // The last line has no newline but is still a word
+        words++;
+        if (offsets != NULL)
+            offsets[words] = size + 1;
+    }
+    if (offsets != NULL)
+        offsets[0] = 0;
+    return words;
+}
+
+// [-r] mode: prints how many lines and palindromes every worker found in its byte range
+void print_ranges() {
+    long words = 0, palins = 0;
+    for (int i = 0; i < shmem->n; i++) {
+        size_t start = fsize * i / shmem->n;
+        size_t end = fsize * (i + 1) / shmem->n;
+        printf(" worker %2d: bytes %zu-%zu, %ld lines, %ld palindromes\n", i + 1, start, end,
+               shmem->range_words[i], shmem->range_palins[i]);
+        words += shmem->range_words[i];
+        palins += shmem->range_palins[i];
+    }
+    printf("     total: %ld lines, %ld palindromes, %ld not\n", words, palins, words - palins);
+}
+
+// [-c slots]: prints how often the verdict cache saved running the kernel
+void print_dedup() {
+    if (analysis == analysis_corpus) { // Not the cache, but printed at the same time
+        printf(" distinct palindromes in the whole input: %ld", shmem->corpus_distinct);
+        if (shmem->corpus_full > 0)
+            printf(" (at least, %ld didn't fit in the set)", shmem->corpus_full);
+        printf("\n");
+    }
+    if (shmem->dedup_slots == 0)
+        return;
+    unsigned long hits = shmem->dedup_hits, misses = shmem->dedup_misses;
+    unsigned long used = 0;
+    for (unsigned long i = 0; i < shmem->dedup_slots; i++) {
+        if (shmem_dedup(shmem)[i].key != 0)
+            used++;
+    }
+    printf(" dedup cache: %lu hits, %lu misses (%.1f%% hit rate), %lu of %lu slots used\n", hits, misses,
+           (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0, used, shmem->dedup_slots);
+}
+
+// Appends "words=W p50_ns=X p99_ns=Y" for this run to the [-b file], if one was given
+void write_stats(std::string exe_name) {
+    if (stats_file.empty())
+        return;
+    FILE* stats = fopen(stats_file.c_str(), "a");
+    if (stats == NULL) {
+        std::string error_msg = exe_name + ": Error: Cannot open the stats file for output";
+        perror(error_msg.c_str());
+        return;
+    }
+    unsigned long words = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) // Every checked word added one sample
+        words += shmem->latency[i];
+    fprintf(stats, "words=%lu p50_ns=%lu p99_ns=%lu\n", words,
+            latency_percentile(shmem->latency, 50), latency_percentile(shmem->latency, 99));
+    fclose(stats);
+}
+
+// Publishes the current time and starts the thread that keeps it up to date
+void start_clock(std::string exe_name) {
+    timepage_publish(&shmem->clock, time(0)); // palin never sees an empty page
+    clock_stop = 0;
+    sigset_t old;
+    block_signals(&old); // Every signal goes to the main thread, tick_clock() only looks at stats_wanted
+    int error = pthread_create(&clock_thread, NULL, tick_clock, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error != 0) {
+        std::string error_msg = exe_name + ": Error: Cannot start the clock thread";
+        perror(error_msg.c_str());
+        exit(EXIT_FAILURE);
+    }
+    clock_running = 1;
+}
+
+// Stops the clock thread right away, it sleeps on clock_stop between ticks
+void stop_clock() {
+    if (!clock_running)
+        return;
+    __atomic_store_n(&clock_stop, 1, __ATOMIC_RELEASE);
+    futex_wake(&clock_stop, 1);
+    pthread_join(clock_thread, NULL);
+    clock_running = 0;
+}
+
+// Clock thread: every TIME_TICK_MS it checks the time, and formats it into the time page
+// whenever the second has changed. It also prints the worker stats when SIGUSR1 asked for
+// them, printf() isn't safe in the signal handler itself.
+void *tick_clock(void*) {
+    while (!__atomic_load_n(&clock_stop, __ATOMIC_ACQUIRE)) {
+        time_t seconds = time(0);
+        if (seconds != shmem->clock.stamp) { // Only master writes the page
+            timepage_publish(&shmem->clock, seconds);
+        }
+        if (stats_wanted) {
+            stats_wanted = 0;
+            print_stats();
+            fflush(stdout);
+        }
+        futex_wait(&clock_stop, 0, TIME_TICK_MS);
+    }
+    return NULL;
+}
+
+// Opens the output files and starts the thread that writes out the log ring
+void start_drain(std::string exe_name) {
+    out_open(&palin_out, "palin.out", exe_name);
+    out_open(&nopalin_out, "nopalin.out", exe_name);
+    out_open(&log_out, "output.log", exe_name);
+    if (analysis != analysis_none) {
+        out_open(&analysis_out, analysis_out_name(analysis), exe_name);
+    }
+    drain_stop = 0;
+    sigset_t old;
+    block_signals(&old);
+    int error = pthread_create(&drain_thread, NULL, drain_log, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error != 0) {
+        std::string error_msg = exe_name + ": Error: Cannot start the thread writing the output files";
+        perror(error_msg.c_str());
+        exit(EXIT_FAILURE);
+    }
+    drain_running = 1;
+}
+
+// Waits for the drain thread to write out everything left in the ring, then closes the files.
+// Only call it once every child has been reaped.
+void stop_drain() {
+    if (!drain_running)
+        return;
+    __atomic_store_n(&drain_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(drain_thread, NULL);
+    drain_running = 0;
+    if (drain_skipped > 0) {
+        printf("[master]: skipped %ld log records a killed palin never finished\n", drain_skipped);
+    }
+    out_submit(&palin_out); // Start the last writes of every file together
+    out_submit(&nopalin_out);
+    out_submit(&log_out);
+    if (analysis != analysis_none) {
+        out_submit(&analysis_out);
+    }
+    out_kick();
+    out_close(&palin_out);
+    out_close(&nopalin_out);
+    out_close(&log_out);
+    if (analysis != analysis_none) {
+        out_close(&analysis_out);
+    }
+}
+
+// Drain thread: takes the results palin pushed out of the ring, in order, and appends them
+// to palin.out or nopalin.out and to output.log. Runs until stop_drain() is called and the
+// ring is empty, or only holds records nobody will ever finish.
+void *drain_log(void*) {
+    struct LogRing* ring = &shmem->log;
+    long last_stamp = -1; // The log time is only formatted again when the second changes
+    char stamp[12];
+    char prefix[64];
+    while (1) {
+        int records = logring_wait(ring, 10);
+        if (records == 0) { // Nothing new
+            if (__atomic_load_n(&drain_stop, __ATOMIC_ACQUIRE)) {
+                // Every child has been reaped, so nothing in the ring changes any more. What
+                // is left at tail was reserved by a palin killed before it published it: skip
+                // all of it up to the next complete entry at once, there is nothing to wait for.
+                int skipped = logring_skip(ring);
+                if (skipped == 0)
+                    break; // Everything they pushed is written
+                drain_skipped += skipped;
+                continue;
+            }
+            if (stream) { // Input trickling in from a pipe: don't sit on results while waiting for more
+                out_submit(&palin_out);
+                out_submit(&nopalin_out);
+                out_submit(&log_out);
+                if (analysis != analysis_none) {
+                    out_submit(&analysis_out);
+                }
+                out_kick(); // One system call for all of them
+            }
+            continue;
+        }
+        struct LogRecord* first = logring_record(ring, 0);
+        struct OutFile* out = (first->kind == log_palin) ? &palin_out : (first->kind == log_nopalin) ? &nopalin_out : &analysis_out;
+        if (first->stamp != last_stamp) {
+            time_t seconds = first->stamp;
+            struct tm formatted;
+            strftime(stamp, sizeof(stamp), "%I:%M:%S %p", localtime_r(&seconds, &formatted));
+            last_stamp = first->stamp;
+        }
+        // Prints the time, PID, Index, and the String to the log file
+        // With [-r] the index is the line's byte offset in the infile, it is printed as it is
+        long index = split ? first->index : first->index + 1;
+        int prefix_length = snprintf(prefix, sizeof(prefix), "[%s], %d, %ld, ", stamp, first->pid, index);
+        out_reserve(out, first->length + 24); // Whole lines only, so make room for all of it first
+        out_reserve(&log_out, prefix_length + first->length + 1);
+        out_write(&log_out, prefix, prefix_length);
+        if (first->kind == log_analysis) { // The analysis out-file starts every line with the index
+            char number[24];
+            out_write(out, number, snprintf(number, sizeof(number), "%ld, ", index));
+        }
+        for (int k = 0; k < records; k++) { // The word is spread over the entry's records
+            int chunk = first->length - k * LOG_TEXT;
+            if (chunk > LOG_TEXT)
+                chunk = LOG_TEXT;
+            out_write(out, logring_record(ring, k)->text, chunk);
+            out_write(&log_out, logring_record(ring, k)->text, chunk);
+        }
+        out_write(out, "\n", 1);
+        out_write(&log_out, "\n", 1);
+        logring_release(ring, records);
+    }
+    return NULL;
+}
+
+// [--ordered] mode: once every child has exited, prints the checked words to palin.out or
+// nopalin.out and to output.log in the same order they are in the infile
+void print_ordered(std::string exe_name) {
+    out_open(&palin_out, "palin.out", exe_name);
+    out_open(&nopalin_out, "nopalin.out", exe_name);
+    out_open(&log_out, "output.log", exe_name);
+
+    // The words weren't logged one at a time, so they all get the time they are printed at
+    time_t seconds = time(0);
+    struct tm formatted;
+    char stamp[12];
+    strftime(stamp, sizeof(stamp), "%I:%M:%S %p", localtime_r(&seconds, &formatted));
+
+    unsigned char* results = shmem_results(shmem);
+    char prefix[64];
+    for (int i = 0; i < shmem->word_total; i++) {
+        unsigned char result = __atomic_load_n(&results[i], __ATOMIC_ACQUIRE);
+        if (!(result & RESULT_DONE)) // Without [-p] only the first [-n x] words get checked
+            continue;
+        const char* word = shmem_word(shmem, fmap, i);
+        int length = shmem_length(shmem, i);
+        int pid = shmem->worker_pid[result & RESULT_SLOT];
+        int prefix_length = snprintf(prefix, sizeof(prefix), "[%s], %d, %d, ", stamp, pid, i+1);
+        out_line((result & RESULT_PALIN) ? &palin_out : &nopalin_out, NULL, 0, word, length);
+        out_line(&log_out, prefix, prefix_length, word, length);
+    }
+
+    out_submit(&palin_out);
+    out_submit(&nopalin_out);
+    out_submit(&log_out);
+    out_kick();
+    out_close(&palin_out);
+    out_close(&nopalin_out);
+    out_close(&log_out);
+}
+
+// Appends prefix, text and a newline as one line, a line too long for the buffer is written on its own
+void out_line(struct OutFile* out, const char* prefix, size_t prefix_length, const char* text, size_t length) {
+    size_t total = prefix_length + length + 1;
+    if (total > OUT_BUFFER) {
+        out_flush(out);
+        out_wait(out); // The line has to land after what is already in flight
+        struct iovec line[3];
+        line[0].iov_base = (void*) prefix;
+        line[0].iov_len = prefix_length;
+        line[1].iov_base = (void*) text;
+        line[1].iov_len = length;
+        line[2].iov_base = (void*) "\n";
+        line[2].iov_len = 1;
+        out_calls++;
+        if (writev(out->fd, line, 3) == -1)
+            perror("master: Error: Cannot write to an output file");
+        else
+            out_bytes += total;
+        return;
+    }
+    out_reserve(out, total);
+    out_write(out, prefix, prefix_length);
+    out_write(out, text, length);
+    out_write(out, "\n", 1);
+}
+
+// Opens "name" for appending, the same way palin used to
+void out_open(struct OutFile* out, const char* name, std::string exe_name) {
+    if (!uring_tried) { // Falls back to write() if io_uring isn't there
+        uring_init(&uring, URING_ENTRIES);
+        uring_tried = true;
+    }
+    out->current = 0;
+    out->used = 0;
+    out->writing = 0;
+    out->fd = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (out->fd == -1) {
+        std::string error_msg = exe_name + ": Error: Cannot open file \"" + name + "\" for output, terminating";
+        perror(error_msg.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Makes sure "length" more bytes fit in the buffer, writing out what is there if they don't
+void out_reserve(struct OutFile* out, size_t length) {
+    if (out->used + length > OUT_BUFFER)
+        out_flush(out);
+}
+
+// Adds bytes to the buffer, out_reserve() has to have made room for them
+void out_write(struct OutFile* out, const char* data, size_t length) {
+    memcpy(out->buf[out->current] + out->used, data, length);
+    out->used += length;
+}
+
+// Queues the buffer to be written by io_uring and switches to the other one, out_kick()
+// passes it to the kernel. The file's previous buffer has to be written first, only one
+// write per file is ever in flight so the lines land in order. Without io_uring the
+// buffer is written right away.
+void out_submit(struct OutFile* out) {
+    if (out->used == 0)
+        return;
+    if (uring.fd == -1) {
+        out_sync(out->fd, out->buf[out->current], out->used);
+        out->used = 0;
+        return;
+    }
+    out_wait(out);
+    while (!uring_write(&uring, out->fd, out->buf[out->current], out->used, (unsigned long) out)) {
+        out_kick(); // Queue full, hand what is there to the kernel first
+    }
+    out->writing = out->used;
+    out->current = !out->current;
+    out->used = 0;
+}
+
+// Passes every write queued by out_submit() to the kernel in one system call
+void out_kick() {
+    if (uring.fd == -1 || uring.queued == 0)
+        return;
+    out_calls++;
+    if (uring_submit(&uring, 0) == -1) {
+        perror("master: Error: Cannot submit writes to io_uring");
+    }
+}
+
+// Starts writing out everything in the buffer, it only ever holds whole lines
+void out_flush(struct OutFile* out) {
+    out_submit(out);
+    out_kick();
+}
+
+// Waits until io_uring has written the file's other buffer, so it can be filled again
+void out_wait(struct OutFile* out) {
+    out_reap();
+    while (out->writing > 0 && uring.fd != -1) {
+        out_calls++;
+        if (uring_submit(&uring, 1) == -1) {
+            if (errno == EINTR) // A signal, the write is still in flight
+                continue;
+            perror("master: Error: Cannot wait for io_uring");
+            exit(EXIT_FAILURE);
+        }
+        out_reap();
+    }
+}
+
+// Picks up the writes io_uring has finished. A write that came up short is finished with
+// write(), and one the kernel can't do through io_uring at all (IORING_OP_WRITE is 5.6+)
+// is done with write() and io_uring isn't used again.
+void out_reap() {
+    unsigned long tag;
+    int result;
+    bool unsupported = false;
+    while (uring.fd != -1 && uring_reap(&uring, &tag, &result)) {
+        struct OutFile* out = (struct OutFile*) tag;
+        const char* buf = out->buf[!out->current];
+        if (result == -EINVAL || result == -EOPNOTSUPP) {
+            out_sync(out->fd, buf, out->writing);
+            unsupported = true;
+        }
+        else if (result < 0) {
+            errno = -result;
+            perror("master: Error: Cannot write to an output file");
+        }
+        else {
+            out_bytes += result;
+            if ((size_t) result < out->writing)
+                out_sync(out->fd, buf + result, out->writing - result);
+        }
+        out->writing = 0;
+    }
+    if (unsupported) // The other writes failed at submission too, their results are already in
+        uring_exit(&uring);
+}
+
+// Writes "length" bytes to "fd" with write() until they are all out
+void out_sync(int fd, const char* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        out_calls++;
+        ssize_t wrote = write(fd, data + done, length - done);
+        if (wrote == -1) {
+            perror("master: Error: Cannot write to an output file");
+            break;
+        }
+        done += wrote;
+    }
+    out_bytes += done;
+}
+
+// Writes out what is left and closes the file
+void out_close(struct OutFile* out) {
+    out_flush(out);
+    out_wait(out);
+    close(out->fd);
+}
+
+// SIGUSR1: asks the clock thread to print the worker stats
+void sig_stats(int) {
+    stats_wanted = 1;
+}
+
+// Prints the counters of every worker slot that checked something and their totals, and
+// where the workers' time went: the check, waiting for the critical section or holding it
+void print_stats() {
+    struct WorkerStats total;
+    memset(&total, 0, sizeof(total));
+    printf(" %6s %10s %10s %12s %10s %10s %10s\n", "worker", "words", "palins", "bytes", "check_ms", "wait_ms", "hold_ms");
+    for (int i = 0; i < PROC_LIMIT; i++) {
+        struct WorkerStats* stats = &shmem->stats[i];
+        unsigned long words = __atomic_load_n(&stats->words, __ATOMIC_RELAXED);
+        if (words == 0)
+            continue;
+        unsigned long palins = __atomic_load_n(&stats->palins, __ATOMIC_RELAXED);
+        unsigned long bytes = __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+        unsigned long check = __atomic_load_n(&stats->check_ns, __ATOMIC_RELAXED);
+        unsigned long wait = __atomic_load_n(&stats->wait_ns, __ATOMIC_RELAXED);
+        unsigned long hold = __atomic_load_n(&stats->hold_ns, __ATOMIC_RELAXED);
+        printf(" %6d %10lu %10lu %12lu %10.1f %10.1f %10.1f\n", i + 1, words, palins, bytes,
+               check / 1e6, wait / 1e6, hold / 1e6);
+        total.words += words;
+        total.palins += palins;
+        total.bytes += bytes;
+        total.check_ns += check;
+        total.wait_ns += wait;
+        total.hold_ns += hold;
+    }
+    printf(" %6s %10lu %10lu %12lu %10.1f %10.1f %10.1f\n", "total", total.words, total.palins, total.bytes,
+           total.check_ns / 1e6, total.wait_ns / 1e6, total.hold_ns / 1e6);
+    double busy = total.check_ns + total.wait_ns + total.hold_ns;
+    if (busy > 0) {
+        printf(" worker time: %.1f%% checking, %.1f%% waiting for the critical section, %.1f%% in it\n",
+               100 * total.check_ns / busy, 100 * total.wait_ns / busy, 100 * total.hold_ns / busy);
+    }
+}
+
+// How many system calls writing the output files took
+void print_output() {
+    printf(" output files: %ld bytes in %ld system calls (%s)\n", out_bytes, out_calls,
+           (uring.fd != -1) ? "io_uring" : "write");
+}
+
+// CTRL+C or the [-t time] timer: kills all child processes and leaves the rest to main, which
+// sees "interrupted" once they are gone and calls finish_interrupted(). Only killpg() and the
+// flag are safe here, the thread this runs on may be in the middle of anything.
 void sig_handle(int signal) {
-    //printf("signal: %d\n", signal);
-    if (signal == 2) {
+    interrupted = signal;
+    if (stream && shmem != NULL) { // Don't let main wait for room in the line ring the workers won't make
+        __atomic_store_n(&shmem->lines.closed, 1, __ATOMIC_RELEASE);
+    }
+    if (!threaded && shmem != NULL && shmem->pgid > 0) { // The segment only exists once the infile has been sized
+        killpg(shmem->pgid, SIGTERM); // Sends a kill signal to the child process group
+    }
+}
+
+// Says which signal interrupted the run
+void report_interrupt() {
+    if (interrupted == SIGINT) {
         printf("\n[master]: CTRL+C was received, interrupting process!\n"); 
     }
-    if (signal == 14) { // "wake up call" for the timer being done
-        printf("\n[master]: The countdown timer [-t time] has ended, interrupting process!\n", signal);
+    if (interrupted == SIGALRM) { // "wake up call" for the timer being done
+        printf("\n[master]: The countdown timer [-t time] has ended, interrupting process!\n");
+    }
+}
+
+// Main, once every child has exited after sig_handle(): writes out the results the children
+// already pushed to the log, or in [--ordered] mode the words already in the result slots,
+// frees shared memory and terminates
+void finish_interrupted(std::string exe_name) {
+    report_interrupt();
+    if (shmem != NULL) {
+        stop_drain();
+        stop_clock();
+        if (ordered) { // Only the words with RESULT_DONE, the rest were never checked
+            print_ordered(exe_name);
+        }
+        free_memory(); // clears all shared memory
     }
-    killpg(shmem->pgid, SIGTERM); // Sends a kill signal to the child process group
-    free_memory(); // clears all shared memory
     exit(0);
 }
 
+// Blocks SIGINT, SIGALRM and SIGUSR1 in the calling thread (the old mask goes in *old), a
+// thread created now inherits that and never runs the handlers
+void block_signals(sigset_t* old) {
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGALRM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, old);
+}
+
 /* 
 struct sigaction {
     void (*sa_handler) (int);
@@ -244,7 +1136,7 @@ void countdown_to_interrupt(int seconds, std::string exe_name) {
     sigemptyset(&action.sa_mask); // Initializes the signal set to empty
     action.sa_handler = &sig_handle; // points to a signal handling function,
               // which specifies the action to be associated with SIGALRM in sigaction()
-    action.sa_flags = SA_RESTART; // Restartable system call
+    action.sa_flags = 0; // Not restarted, like SIGINT: main has to get out of wait() to act on it
     // SIGALRM below is an asynchronous call, the signal raised when the time interval specified expires
     if (sigaction(SIGALRM, &action, NULL) == -1) { 
         // &action specifies the action to be taken when the timer is done
@@ -281,18 +1173,41 @@ void errors(std::string name, std::string message) {
 
 // Prints a usage message about how to properly use this program
 void usage(std::string name) {
-    printf("\n%s: Usage: ./master [-n x] [-s x] [-t time] infile\n", name.c_str());
+    printf("\n%s: Usage: ./master [-n x] [-s x] [-t time] [-p] [-r] [-T] [-l lock] [-o|--ordered] [-u|--utf8] [-c slots] [-a mode] [-b file] infile\n", name.c_str());
     printf("%s: Help:  ./master -h\n                    [-h] will display how the project should be run and then terminate.\n", name.c_str());
     printf("    [-n x] where x is the max total of child processes master will ever create. (Default 4)\n");
     printf("    [-s x] where x is the number of children allowed to exist at one time in the system. (Default 2)\n");
     printf("    [-t time] where time is the max time you want the program to run before terminating. (Default 100)\n");
-    printf("    [infile] is the name of the input file containing strings to be tested.\n\n");
+    printf("    [-p] pre-forks [-s x] palin workers once, which pull words from shared memory until it is drained.\n");
+    printf("    [-r] like [-p], but every worker checks the lines starting in its own byte range of the infile.\n");
+    printf("    [-T] checks the words on [-s x] threads inside master instead of palin processes, output is in input order.\n");
+    printf("    [-l lock] where lock is futex (queued lock, waiters sleep) or em (flag/turn algorithm, waiters spin). (Default futex)\n");
+    printf("    [-o|--ordered] skips the critical section, the results are printed in the order of the infile at the end.\n");
+    printf("    [-u|--utf8] the words are UTF-8: letters are compared after Unicode case folding, and all punctuation,\n");
+    printf("                symbols and spaces are skipped, not just ASCII ones. (Default off)\n");
+    printf("    [-c slots] caches the verdicts of up to slots normalized words in shared memory, repeated words skip the check. (Default 0, off)\n");
+    printf("    [-a mode] where mode is lps: palin writes the longest palindromic substring of every line to lps.out,\n");
+    printf("              distinct: the number of distinct palindromic substrings of every line to distinct.out,\n");
+    printf("              corpus: like distinct, plus how many were new to the input, and the total at the end.\n");
+    printf("    [-b file] appends the number of words checked and the p50/p99 latency per word to file (used by bench).\n");
+    printf("    [infile] is the name of the input file containing strings to be tested, - reads them from stdin with a pool of workers.\n\n");
     exit(EXIT_FAILURE);
 }
 
 // Takes the shared memory struct and frees the shared memory
 void free_memory() {
+    if (threaded) { // The table is on the heap, there is no segment
+        free(shmem);
+        shmem = NULL;
+        if (fsize > 0) {
+            munmap(fmap, fsize);
+        }
+        return;
+    }
     shmdt(shmem); // Detaches the shared memory of "shmem" from the address space of the calling process
     shmctl(sid, IPC_RMID, NULL); // Performs the IPC_RMID command on the shared memory segment with ID "sid"
     // IPC_RMID -- marks the segment to be destroyed. This will only occur after the last process detaches it.
+    if (fsize > 0) {
+        munmap(fmap, fsize); // Unmaps the infile
+    }
 }
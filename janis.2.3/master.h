@@ -9,9 +9,54 @@ File: master.h
 */
 
 #include <string>
+#include <stddef.h>
+#include <signal.h>
+
+#define OUT_BUFFER (1 << 20) // Bytes master collects for an output file before writing them
+
+// An output file master appends to, only whole lines are ever written to it. Lines are
+// collected in one buffer while the other one may still be being written by io_uring.
+struct OutFile {
+    int fd;
+    int current; // Buffer the lines go into
+    size_t used; // Bytes waiting in buf[current]
+    size_t writing; // Bytes of the other buffer io_uring is writing, 0 if it is free
+    char buf[2][OUT_BUFFER];
+};
 
 void try_spawn(int, std::string);
+void run_threads(int);
+void check_words(int);
+void read_stdin();
+void start_clock(std::string);
+void stop_clock();
+void *tick_clock(void*);
+void start_drain(std::string);
+void stop_drain();
+void *drain_log(void*);
+void print_ordered(std::string);
+void print_ranges();
+void print_dedup();
+void write_stats(std::string);
+void out_line(struct OutFile*, const char*, size_t, const char*, size_t);
+void out_open(struct OutFile*, const char*, std::string);
+void out_reserve(struct OutFile*, size_t);
+void out_write(struct OutFile*, const char*, size_t);
+void out_submit(struct OutFile*);
+void out_kick();
+void out_flush(struct OutFile*);
+void out_wait(struct OutFile*);
+void out_reap();
+void out_sync(int, const char*, size_t);
+void out_close(struct OutFile*);
+void print_output();
+void sig_stats(int);
+void print_stats();
+int scan_lines(const char*, size_t, size_t*);
 void sig_handle(int);
+void report_interrupt();
+void finish_interrupted(std::string);
+void block_signals(sigset_t*);
 void countdown_to_interrupt(int, std::string);
 void clock(int, std::string);
 void errors(std::string, std::string);
@@ -14,6 +14,12 @@
 	 the critical section to perform printing operations to outfiles and a log file. Once the process
 	 that was allowed into the critical section is finished, code is executed to exit the critical section.
 
+     When master was started with [-p], palin runs as a long-lived pool worker instead: XX is the
+     worker's slot, and it keeps claiming word indices from the work queue in shared memory (next_word)
+     until every word has been checked. With [-r] the worker doesn't claim words, it checks every line
+     that starts in its share of the infile's bytes and reports how many it checked. When master reads the words from stdin (infile "-") the
+     worker takes lines out of the line ring in shared memory instead, until master closes it.
+
 */
 
 #include <cstring>
@@ -21,7 +27,10 @@
 #include <time.h>
 #include <string>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/uio.h>
 #include "palin.h"
+#include "kernel.h"
 #include "shared.h"
 
 int n; // Keeps track of the number of child processes to be spawned
@@ -29,10 +38,15 @@ int child_count; // Keeps track of the number of children throughout program
 struct Shmem* shmem; // struct instance for shared memory
 key_t skey; // Unique key for using shared memory
 int sid; // Shared memory segment ID
+const char* fmap = NULL; // The infile, mapped read-only into memory
+struct Arena arena = {NULL, 0, 0}; // Scratch memory for the analysis modes, reused for every line
+int pid; // PID of this palin, looked up once
 
 int main(int argc, char *argv[]) {
 
     srand(time(NULL)); // Seed the random number generator once for the sleep() later on
+    palin_kernel_init(); // Picks the fastest palindrome kernel this CPU supports
+    pid = getpid();
 
     std::string error_msg; // For perror's
 
@@ -40,7 +54,6 @@ int main(int argc, char *argv[]) {
     signal(SIGTERM, sig_handler);    
 
     int word_count; // Used for synchronizing the # child processes and words in the array (shared memory)
-    bool is_palin = false; // used for checking palindrome or not
 
     if (argc != 2) { // Checks that there were two arguments (./palin XX)
         perror("palin: Error: Not enough arguments were passed, terminating");
@@ -57,11 +70,10 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
     
-    // Tries to allocate a shared memory segment, otherwise it will use the 
-    // previously allocated shared memory segment
-    if ((sid = shmget(skey, sizeof(struct Shmem), IPC_CREAT | 0666)) < 0) { 
-        // if the sid is < 0, it couldn't allocate a shared memory segment
-        perror("palin: shmget: Error: An error occurred while trying to allocate a valid shared memory segment");
+    // Looks up the segment master allocated (its size depends on the infile, so only master creates it)
+    if ((sid = shmget(skey, 0, 0)) < 0) { 
+        // if the sid is < 0, there is no shared memory segment to attach to
+        perror("palin: shmget: Error: An error occurred while trying to find the shared memory segment");
         exit(EXIT_FAILURE);
     }
     else {
@@ -70,55 +82,171 @@ int main(int argc, char *argv[]) {
         // Since shmaddr is NULL, system chooses a suitable (unused) page-aligned address to attach the segment
     }
 
-    // Starts the word count at the right index (index 0)
-    char* string = shmem->words[word_count];
+    // Map the infile master published, the words are read straight from the page cache
+    if (shmem->file_size > 0) { // An empty infile has no words and can't be mapped
+        int fd = open(shmem->infile, O_RDONLY);
+        if (fd == -1) {
+            perror("palin: Error: Cannot open the infile for reading, terminating");
+            exit(EXIT_FAILURE);
+        }
+        fmap = (const char*) mmap(NULL, shmem->file_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (fmap == MAP_FAILED) {
+            perror("palin: mmap: Error: Cannot map the infile into memory, terminating");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
 
-    // Removes any trailing newlines and replaces with null-terminator
-    for (int i = 0; string[i] != '\0'; i++) {
-        if (string[i] == '\n') {
-            string[i] = '\0';
+    shmem->worker_pid[shmem->pool ? child_count-1 : word_count] = pid; // For the log in [--ordered] mode
+
+    if (shmem->stream) { // Pool worker fed from master's stdin: take lines until master closes the ring
+        char* line = NULL; // This worker's copy of the line, grown to fit the longest one so far
+        size_t capacity = 0;
+        int length;
+        long index;
+        while ((index = linering_take(&shmem->lines, &line, &capacity, &length)) != -1) {
+            unsigned long start = now_ns();
+            check_line(child_count-1, index, line, length);
+            latency_add(shmem->latency, now_ns() - start);
+        }
+        free(line);
+    }
+    else if (shmem->split) { // Pool worker with its own byte range of the infile
+        check_range(child_count-1);
+    }
+    else if (shmem->pool) { // Pool worker: keep claiming words until the queue in shared memory is drained
+        int next;
+        while ((next = __sync_fetch_and_add(&shmem->next_word, 1)) < shmem->word_total) {
+            unsigned long start = now_ns();
+            check_word(child_count-1, next); // child_count-1 is this worker's slot in flag[]
+            latency_add(shmem->latency, now_ns() - start); // From claiming the word to its result being out
         }
     }
+    else { // One palin per word: the word index is also the slot in flag[]
+        unsigned long start = now_ns();
+        check_word(word_count, word_count);
+        latency_add(shmem->latency, now_ns() - start);
+    }
+
+    return 0;
+}
 
-    int length = strlen(string);
-    char temp_str[length];
-    strcpy(temp_str, string); // Saves the original string into temp_str
+// Tests the word at index word_count of the mapped infile, see check_line()
+void check_word(const int i, int word_count) {
+    // Checks the word in place, straight from the mapped infile (nothing is copied or allocated)
+    check_line(i, word_count, shmem_word(shmem, fmap, word_count), shmem_length(shmem, word_count));
+}
 
-    // Temporarily remove punctuation, capitalization, and spaces from "string"
-    int index = 0;
-    char c;
-    while(string[index]) { // Loops through every character
-        c = string[index]; // Grabs a character
-        string[index] = tolower(c); // Makes sure the letters are lowercase
-        if (ispunct(c) != 0) // If there is punctuation,
-            string[index] = ' '; // replace it with a space
-        if (isspace(c) != 0) // If there is a space (or tab),
-            string[index] = ' '; // replace it with a space
-        index++; // Move to next character
+// [-r] worker i: the infile is cut into shmem->n byte ranges of the same size and every line
+// belongs to the range its first byte is in. The worker finds the first line that starts in
+// its range itself, checks lines until it passes the end of the range (the last one may run
+// past it) and leaves how many lines and palindromes it found in shared memory for master.
+// The index logged for each line is its byte offset, nobody counted the lines before it.
+void check_range(const int i) {
+    size_t size = shmem->file_size;
+    size_t start = size * i / shmem->n;
+    size_t end = size * (i + 1) / shmem->n;
+    if (start > 0 && fmap[start-1] != '\n') { // Started in the middle of a line, it belongs to worker i-1
+        const char* newline = (const char*) memchr(fmap + start, '\n', size - start);
+        start = (newline != NULL) ? newline - fmap + 1 : size;
     }
-    index = 0; // Now to remove the spaces
-    for (int i = 0; string[i]; i++) { // For every character in the string,
-        if (string[i] != ' ') // If theres a space, skip it and its index
-            string[index++] = string[i];
+    long words = 0, palins = 0;
+    while (start < end) {
+        const char* newline = (const char*) memchr(fmap + start, '\n', size - start);
+        size_t stop = (newline != NULL) ? newline - fmap : size; // The last line may have no newline
+        unsigned long begin = now_ns();
+        if (check_line(i, start, fmap + start, stop - start))
+            palins++;
+        latency_add(shmem->latency, now_ns() - begin);
+        words++;
+        start = stop + 1;
     }
-    string[index] = '\0'; // C-strings have a null terminator at the end
+    shmem->range_words[i] = words;
+    shmem->range_palins[i] = palins;
+}
 
-    // Checks if a string is a palindrome or not, returns true or false
-    is_palin = palin_check(string);
-    
-    strcpy(shmem->words[word_count], temp_str); // Return the original string to shared memory
+// Tests "word", the line at index word_count, and then enters the critical section as process i.
+// Returns true if it is a palindrome.
+bool check_line(const int i, long word_count, const char* word, int length) {
+    unsigned long begin = now_ns();
+    if (shmem->analysis != analysis_none) { // Report on the line instead of checking it
+        char* result;
+        int result_length;
+        if (shmem->analysis == analysis_lps) {
+            result_length = analyze_lps(&arena, word, length, shmem->utf8, &result);
+        }
+        else { // analysis_distinct, or analysis_corpus which also adds to the set for the whole infile
+            bool corpus = (shmem->analysis == analysis_corpus);
+            long added, full;
+            result_length = analyze_distinct(&arena, word, length, shmem->utf8, corpus ? shmem_palindromes(shmem) : NULL,
+                                             shmem->palindrome_slots, &added, &full, &result);
+            if (corpus) {
+                __atomic_add_fetch(&shmem->corpus_distinct, added, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&shmem->corpus_full, full, __ATOMIC_RELAXED);
+            }
+        }
+        if (!shmem->pool) {
+            fprintf(stderr, "[%s] executing code to enter critical section\n", get_time());
+        }
+        count_line(i, length, false, begin);
+        process(i, word_count, result, result_length, log_analysis);
+        return false;
+    }
+
+    bool is_palin = shmem_check(shmem, word, length); // used for checking palindrome or not (cached with [-c slots])
+    count_line(i, length, is_palin, begin);
+
+    if (shmem->ordered) { // Leave the result in the word's slot, master prints them all in order
+        unsigned char result = RESULT_DONE | (is_palin ? RESULT_PALIN : 0) | i;
+        __atomic_store_n(&shmem_results(shmem)[word_count], result, __ATOMIC_RELEASE);
+        return is_palin;
+    }
 
     // process() handles the critical section problem
-    fprintf(stderr, "[%s] executing code to enter critical section\n", get_time());
-    process(word_count, is_palin);
+    if (!shmem->pool) {
+        fprintf(stderr, "[%s] executing code to enter critical section\n", get_time());
+    }
+    process(i, word_count, word, length, is_palin ? log_palin : log_nopalin);
+    return is_palin;
+}
 
-    return 0;
+// Adds a checked line to worker i's counters, "begin" is when the check started
+void count_line(const int i, int length, bool is_palin, unsigned long begin) {
+    struct WorkerStats* stats = &shmem->stats[i];
+    stats_add(&stats->check_ns, now_ns() - begin);
+    stats_add(&stats->words, 1);
+    stats_add(&stats->bytes, length);
+    if (is_palin)
+        stats_add(&stats->palins, 1);
+}
+
+// Runs the critical section for the word as process i, one process at a time. "kind" is the
+// log_kind of the result: the word is a palindrome, isn't one, or is an analysis result.
+void process(const int i, long word_count, const char* word, int length, int kind) {
+    unsigned long asked = now_ns();
+    enter_critical_section(i);
+    unsigned long entered = now_ns();
+
+        /* NOW ENTERING CRITICAL SECTION */
+
+    critical_section(word_count, word, length, kind); // (the word being printed, is its string a palindrome or not)
+
+        /* EXECUTE CODE TO EXIT FROM CRITICAL SECTION */
+
+    exit_critical_section(i);
+    stats_add(&shmem->stats[i].wait_ns, entered - asked);
+    stats_add(&shmem->stats[i].hold_ns, now_ns() - entered);
 }
 
-// This function was HEAVILY inspired by the Multiple process solution
-// of the Peterson's Algorithm from the book/slides
-void process(const int i, bool is_palin) {
+// Waits until process i is allowed into the critical section
+void enter_critical_section(const int i) {
+    if (shmem->lock == lock_futex) { // Sleep in the kernel until our ticket comes up
+        qlock_acquire(&shmem->cs_lock);
+        return;
+    }
 
+    // Otherwise spin on the flags, this part was HEAVILY inspired by the Multiple process
+    // solution of the Peterson's Algorithm from the book/slides
     n = shmem->n; // The number of child processes to be spawned
 
     int j; // Local variable for the next waiting process
@@ -146,100 +274,106 @@ void process(const int i, bool is_palin) {
        it isn't i's turn AND the j's flag is not idle (want_in or in_cs) */
 
     shmem->turn = i; // Assign turn to self and enter critical section
+}
 
-        /* NOW ENTERING CRITICAL SECTION */
-
-    critical_section(i, is_palin); // (i was word_count, is its string a palindrome or not)
-
-        /* EXECUTE CODE TO EXIT FROM CRITICAL SECTION */
+// Lets the next waiting process into the critical section
+void exit_critical_section(const int i) {
+    if (shmem->lock == lock_futex) { // Hand over to the next ticket, waking it if it sleeps
+        qlock_release(&shmem->cs_lock);
+        return;
+    }
 
-    j = (shmem->turn + 1) % n;
+    int j = (shmem->turn + 1) % n;
     while (shmem->flag[j] == idle) // Exit section
         j = (j + 1) % n; 
     shmem->turn = j; // Assign turn to the next waiting process
     shmem->flag[i] = idle; // Lower flag of the current process
 }
 
-// Prints logs, prints the palindromes to the correct out-files
-void critical_section(int word_count, bool is_palin) {
-    fprintf(stderr, "[%s] ENTERED - Critical Section\n", get_time());
-    int random = (rand() % 3) + 0; // Sets random to a random integer 0-2
-    sleep(random); // Sleeps for a random amount of time (0 to 2 seconds)
-    if (is_palin) { // If it is a palindrome, print the word to palin.out
-        FILE *palin = fopen("palin.out", "a");
-        if (palin == NULL) { // make sure the file opens
-            perror("palin: Error: Cannot open file \"palin.out\" for output, terminating");
-            exit(EXIT_FAILURE);
+// Hands the result for the word to master, which prints it to the correct out-file and the log
+// (the word isn't null-terminated, so it is printed with %.*s)
+void critical_section(long word_count, const char* word, int length, int kind) {
+    if (!shmem->pool) { // One palin per word shows what it is doing, pool workers stay quiet
+        fprintf(stderr, "[%s] ENTERED - Critical Section\n", get_time());
+        int random = (rand() % 3) + 0; // Sets random to a random integer 0-2
+        sleep(random); // Sleeps for a random amount of time (0 to 2 seconds)
+        if (kind == log_palin) {
+            printf("\nPALIN! -> %.*s\n\n", length, word);
+        }
+        else if (kind == log_analysis) {
+            printf("\nANALYSIS! -> %.*s\n\n", length, word);
+        }
+        else {
+            printf("\nnonPALIN! -> %.*s\n\n", length, word);
         }
-        printf("\nPALIN! -> %s\n\n", shmem->words[word_count]);
-        fprintf(palin, "%s\n", shmem->words[word_count]);
-        fclose(palin); // close the file
-    }
-    else { // If it is not a palindrome, print the word to nopalin.out
-        FILE *nopalin = fopen("nopalin.out", "a");
-        if (nopalin == NULL) { // make sure the file opens
-            perror("palin: Error: Cannot open file \"nopalin.out\" for output, terminating");
-            exit(EXIT_FAILURE);
-        }   
-        printf("\nnonPALIN! -> %s\n\n", shmem->words[word_count]);
-        fprintf(nopalin, "%s\n", shmem->words[word_count]);
-        fclose(nopalin); // close the file
     }
 
-    FILE *logfile = fopen("output.log", "a+");
-    if (logfile == NULL) { // make sure the logfile opens
-        perror("palin: Error: Cannot open log file for output, terminating");
-        exit(1);
-    } // Prints the time, PID, Index, and the String to the log file
-    fprintf(logfile, "[%s], %d, %d, %s\n", get_time(), getpid(), word_count+1, shmem->words[word_count]);
-    fclose(logfile); // close the log file
+    // Push the result into the log ring, master writes palin.out/nopalin.out and output.log
+    long stamp = __atomic_load_n(&shmem->clock.stamp, __ATOMIC_RELAXED); // master's clock, no time() call
+    if (!logring_push(&shmem->log, kind, word_count, pid, stamp, word, length)) {
+        write_direct(word_count, kind, word, length); // Too long for the ring
+    }
 
-    fprintf(stderr, "[%s] EXITED - Critical Section\n", get_time());
+    if (!shmem->pool) {
+        fprintf(stderr, "[%s] EXITED - Critical Section\n", get_time());
+    }
 } // Leaving the critical section
 
-void sig_handler(int signal) {
-    if (signal == 15) {
-        printf("[palin]: kill signal has been received, interrupting process!\n");
+// Appends a word that is too long for the log ring to the out-file and the log file directly.
+// Each line goes out in a single writev() on a file opened for appending, so it can't end up
+// in the middle of a line master is writing.
+void write_direct(long word_count, int kind, const char* word, int length) {
+    const char* name = (kind == log_palin) ? "palin.out" : (kind == log_nopalin) ? "nopalin.out" : analysis_out_name(shmem->analysis);
+    char prefix[64];
+    long index = shmem->split ? word_count : word_count+1; // [-r] logs the byte offset as it is
+    int prefix_length = snprintf(prefix, sizeof(prefix), "[%s], %d, %ld, ", get_time(), pid, index);
+    struct iovec line[3];
+    line[0].iov_base = prefix;
+    line[0].iov_len = prefix_length;
+    line[1].iov_base = (void*) word;
+    line[1].iov_len = length;
+    line[2].iov_base = (void*) "\n";
+    line[2].iov_len = 1;
+
+    int out = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (out == -1) { // make sure the file opens
+        perror("palin: Error: Cannot open out-file for output, terminating");
         exit(EXIT_FAILURE);
     }
-}
-
-// This function returns true if the given char* is a palindrome, false if not
-bool palin_check(char* temp) {
-    int size = strlen(temp);
-    char* backward = new char[size];
-    strcpy(backward, temp); 
-    backward = strrev(backward); // Reverses the string to be compared below
-    if (strcmp(temp, backward) ==  0) {
-        return true;
+    if (kind == log_analysis) { // The analysis out-file starts every line with the index
+        char number[24];
+        struct iovec numbered[3] = {{number, (size_t) snprintf(number, sizeof(number), "%ld, ", index)}, line[1], line[2]};
+        writev(out, numbered, 3);
     }
     else {
-        return false;
+        writev(out, line + 1, 2); // The out-files only get the word
+    }
+    close(out);
+
+    int logfile = open("output.log", O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logfile == -1) { // make sure the logfile opens
+        perror("palin: Error: Cannot open log file for output, terminating");
+        exit(EXIT_FAILURE);
     }
+    writev(logfile, line, 3); // Prints the time, PID, Index, and the String to the log file
+    close(logfile);
 }
 
-// This function reverses and returns the reversed string
-char *strrev(char* string) {
-    if (!string || ! *string) // Check that it is a string
-        return string;
-    int old_length = strlen(string) - 1;
-    int new_length = 0;
-    char ch;
-    while (old_length > new_length) {
-        ch = string[old_length];
-        string[old_length] = string[new_length];
-        string[new_length] = ch;
-        old_length--;
-        new_length++;
-    }
-    return string;
+void sig_handler(int signal) {
+    if (signal == 15) {
+        printf("[palin]: kill signal has been received, interrupting process!\n");
+        exit(EXIT_FAILURE);
+    }
 }
 
-// This function gets the local time at the time of calling
-char *get_time() {
-    time_t seconds = time(0); // Holds the current time from system
-    struct tm * formatted = localtime(&seconds); // gives local time representation of timer
-    char* ch_time = new char[12]; // Allocates new memory for a char ptr array
-    strftime(ch_time, 12, "%I:%M:%S %p", formatted); // Store the formatted time
-    return (char*) ch_time; // Returns a formatted time to be printed
+// Returns the local time, copied out of the time page master keeps up to date in shared
+// memory (no system call, no allocation). The text stays valid until the next call.
+const char *get_time() {
+    static char ch_time[TIME_TEXT];
+    if (timepage_read(&shmem->clock, ch_time) == 0) { // master hasn't published a time yet
+        time_t seconds = time(0);
+        struct tm formatted;
+        strftime(ch_time, sizeof(ch_time), "%I:%M:%S %p", localtime_r(&seconds, &formatted));
+    }
+    return ch_time;
 }
@@ -8,11 +8,16 @@ Date: 10/8/20
 File: palin.h
 */
 
-void process(const int, bool);
-void critical_section(int, bool);
+void check_word(const int, int);
+void check_range(const int);
+bool check_line(const int, long, const char*, int);
+void count_line(const int, int, bool, unsigned long);
+void process(const int, long, const char*, int, int);
+void enter_critical_section(const int);
+void exit_critical_section(const int);
+void critical_section(long, const char*, int, int);
+void write_direct(long, int, const char*, int);
 void sig_handler(int);
-bool palin_check(char*);
-char *strrev(char*);
-char *get_time();
+const char *get_time();
 
 #endif
@@ -0,0 +1,69 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: qlock.cpp
+    Purpose:
+     A queued ticket lock that works between processes through shared memory. Every
+     process takes a ticket, and tickets enter the critical section strictly in the order
+     they were handed out (first come, first served). Unlike the flag/turn algorithm in
+     palin, a process waiting for its turn doesn't spin on shared memory: it sleeps in
+     the kernel on a futex, so waiting costs no CPU time.
+
+     Each ticket waits on its own word (slot[ticket % QLOCK_SLOTS].grant), so releasing
+     the lock wakes exactly the next process in line instead of every waiter. The slot's
+     "waiting" flag lets the releasing process skip the futex_wake() system call when the
+     next process hasn't gone to sleep yet.
+
+*/
+
+#include <limits.h>
+#include "futex.h"
+#include "qlock.h"
+
+#define QLOCK_SPIN 100 // Checks of the grant word before going to sleep in the kernel
+
+// Sets up an unlocked lock, ticket 0 is allowed in first
+void qlock_init(struct Qlock* lock) {
+    lock->next_ticket = 0;
+    lock->owner = 0;
+    for (unsigned int i = 0; i < QLOCK_SLOTS; i++) {
+        // Each slot remembers the last ticket it let in, the one before ticket i is i - QLOCK_SLOTS
+        lock->slot[i].grant = (i == 0) ? 0 : i - QLOCK_SLOTS;
+        lock->slot[i].waiting = 0;
+    }
+}
+
+// Takes a ticket and waits (asleep) until it is that ticket's turn
+void qlock_acquire(struct Qlock* lock) {
+    unsigned int ticket = __atomic_fetch_add(&lock->next_ticket, 1, __ATOMIC_ACQ_REL);
+    struct QlockSlot* slot = &lock->slot[ticket % QLOCK_SLOTS];
+
+    // The lock is usually handed over quickly, so look a few times before paying for a sleep
+    for (int spin = 0; spin < QLOCK_SPIN; spin++) {
+        if (__atomic_load_n(&slot->grant, __ATOMIC_ACQUIRE) == ticket)
+            break;
+        cpu_relax();
+    }
+
+    unsigned int grant;
+    while ((grant = __atomic_load_n(&slot->grant, __ATOMIC_ACQUIRE)) != ticket) {
+        // Announce the sleep, then look again: either the releasing process sees the flag and
+        // wakes us, or we see its grant here (both sides use sequentially consistent ordering)
+        __atomic_store_n(&slot->waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&slot->grant, __ATOMIC_SEQ_CST) != ticket)
+            futex_wait(&slot->grant, grant);
+    }
+    __atomic_store_n(&slot->waiting, 0, __ATOMIC_RELAXED);
+    lock->owner = ticket;
+}
+
+// Hands the lock to the next ticket in line, waking it only if it is asleep
+void qlock_release(struct Qlock* lock) {
+    unsigned int next = lock->owner + 1;
+    struct QlockSlot* slot = &lock->slot[next % QLOCK_SLOTS];
+    __atomic_store_n(&slot->grant, next, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&slot->waiting, __ATOMIC_SEQ_CST))
+        futex_wake(&slot->grant, INT_MAX);
+}
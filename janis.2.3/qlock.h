@@ -0,0 +1,30 @@
+#ifndef QLOCK_H
+#define QLOCK_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: qlock.h
+*/
+
+#define QLOCK_SLOTS 128 // Power of two, more than the number of processes that can wait at once
+
+// One waiting position in the queue, on its own cache line so waiters don't share one
+struct QlockSlot {
+    unsigned int grant; // Ticket allowed to enter next through this slot, waiters futex-sleep on it
+    unsigned int waiting; // 1 while the waiter in this slot is (about to be) asleep in the kernel
+} __attribute__((aligned(64)));
+
+// FIFO ticket lock for processes sharing memory, waiters sleep on a futex instead of spinning
+struct Qlock {
+    unsigned int next_ticket; // Next ticket to hand out
+    unsigned int owner; // Ticket of the process inside the critical section
+    struct QlockSlot slot[QLOCK_SLOTS]; // Ticket t waits in slot[t % QLOCK_SLOTS]
+};
+
+void qlock_init(struct Qlock*);
+void qlock_acquire(struct Qlock*);
+void qlock_release(struct Qlock*);
+
+#endif
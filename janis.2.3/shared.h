@@ -17,15 +17,128 @@ File: shared.h
 #include <sys/ipc.h>
 #include <sys/stat.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include "qlock.h"
+#include "logring.h"
+#include "linering.h"
+#include "latency.h"
+#include "stats.h"
+#include "timepage.h"
+#include "dedup.h"
+#include "kernel.h"
+#include "analysis.h"
+
+#define PROC_LIMIT 27 // Upper bound on [-n x], also the size of the flag[] array
 
 enum state {idle, want_in, in_cs};
 
+enum lock_type {lock_futex, lock_em}; // How palin guards its critical section [-l lock]
+
+// Result slot of a word in [--ordered] mode, 0 until a palin has checked the word
+#define RESULT_DONE 0x80 // The word has been checked
+#define RESULT_PALIN 0x40 // The word is a palindrome
+#define RESULT_SLOT 0x3F // Slot (worker_pid[] index) of the palin that checked it
+
+/* The words themselves are never copied into shared memory. Master and every palin
+   mmap the infile read-only, and the segment only publishes where each line starts:
+   the Shmem header is followed by word_total+1 byte offsets into the file. The last
+   offset is where the next word would start if the file went on (as if the last line
+   ended with a newline), so the length of word i is always offset[i+1] - offset[i] - 1.
+   After the offsets comes one result byte per word, used by [--ordered] mode, and then
+   (8-byte aligned) the dedup_slots entries of the verdict cache (see dedup.h) and the
+   palindrome_slots entries of the set of palindromes seen in [-a corpus] mode. */
 struct Shmem {
     int pgid;
     int n;
     int turn;
-    char words[100][MAX_CANON];
-    state flag[100];
+    int pool; // 1 if master pre-forked a pool of palin workers [-p], 0 for one palin per word
+    int word_total; // Number of words (lines) master found in the infile
+    int next_word; // Pool work queue, index of the next word to be claimed by a worker
+    size_t file_size; // Size of the infile in bytes
+    char infile[PATH_MAX]; // Absolute path of the infile, so palin can mmap it too
+    int lock; // lock_futex (queued futex lock) or lock_em (Eisenberg-McGuire flag/turn algorithm)
+    int ordered; // 1 if palin stores results in the result slots and master prints them in order [--ordered]
+    int split; // 1 if every worker checks the lines starting in its own byte range of the infile [-r]
+    long range_words[PROC_LIMIT]; // [-r] lines each worker checked
+    long range_palins[PROC_LIMIT]; // [-r] palindromes each worker found
+    int analysis; // analysis_none, or what palin reports about every line instead of a verdict [-a mode]
+    int stream; // 1 if the words come from master's stdin through the line ring instead of the mapped infile
+    int utf8; // 1 if the words are checked as UTF-8 text [-u]
+    int worker_pid[PROC_LIMIT]; // PID of the palin in each slot, for the log file in [--ordered] mode
+    state flag[PROC_LIMIT];
+    struct Qlock cs_lock; // Critical section lock used with lock_futex
+    struct LogRing log; // Results pushed by palin, written to the out-files and log file by master
+    unsigned long latency[LATENCY_BUCKETS]; // Histogram of the time each word took, in nanoseconds
+    struct WorkerStats stats[PROC_LIMIT]; // Live counters of each worker slot, printed by master
+    struct LineRing lines; // Lines master read from stdin, waiting for a pool worker (infile "-")
+    struct TimePage clock; // The current time, formatted by master for palin's messages and log lines
+    unsigned long dedup_slots; // Entries in the verdict cache after the result bytes, 0 if it is off [-c slots]
+    unsigned long dedup_hits __attribute__((aligned(64))); // Words the cache answered
+    unsigned long dedup_misses __attribute__((aligned(64))); // Words that went through the kernel
+    unsigned long palindrome_slots; // Entries in the [-a corpus] set after the cache, 0 in other modes
+    long corpus_distinct __attribute__((aligned(64))); // [-a corpus] distinct palindromes in the whole infile
+    long corpus_full; // [-a corpus] palindromes that didn't fit in the set (not counted)
 };
 
+// Out-file the results of an analysis mode go to
+inline const char* analysis_out_name(int analysis) {
+    return (analysis == analysis_lps) ? "lps.out" : "distinct.out";
+}
+
+// Total size of a segment that indexes "words" words, has a cache of "slots" verdicts and a
+// set of "palindromes" hashes
+inline size_t shmem_size(int words, unsigned long slots, unsigned long palindromes) {
+    size_t results = (words + 7) & ~7; // Keeps the cache 8-byte aligned
+    return sizeof(struct Shmem) + (words + 1) * sizeof(size_t) + results + slots * sizeof(struct DedupEntry) +
+           palindromes * sizeof(unsigned long);
+}
+
+// The line offsets start right after the header
+inline size_t* shmem_offsets(struct Shmem* shmem) {
+    return (size_t*) (shmem + 1);
+}
+
+// The result bytes start right after the line offsets
+inline unsigned char* shmem_results(struct Shmem* shmem) {
+    return (unsigned char*) (shmem_offsets(shmem) + shmem->word_total + 1);
+}
+
+// The verdict cache starts after the result bytes
+inline struct DedupEntry* shmem_dedup(struct Shmem* shmem) {
+    return (struct DedupEntry*) (shmem_results(shmem) + ((shmem->word_total + 7) & ~7));
+}
+
+// The [-a corpus] set starts after the verdict cache
+inline unsigned long* shmem_palindromes(struct Shmem* shmem) {
+    return (unsigned long*) (shmem_dedup(shmem) + shmem->dedup_slots);
+}
+
+// Checks if the word is a palindrome, asking the verdict cache first when there is one
+inline bool shmem_check(struct Shmem* shmem, const char* word, size_t length) {
+    kernel_fn check = shmem->utf8 ? palin_kernel_utf8 : palin_kernel;
+    if (shmem->dedup_slots == 0)
+        return check(word, length);
+    unsigned long tag; // Normalized length and second hash, see dedup.h
+    unsigned long hash = shmem->utf8 ? palin_hash_utf8(word, length, &tag) : palin_hash(word, length, &tag);
+    bool is_palin;
+    if (dedup_lookup(shmem_dedup(shmem), shmem->dedup_slots, hash, tag, &is_palin)) {
+        __atomic_add_fetch(&shmem->dedup_hits, 1, __ATOMIC_RELAXED);
+        return is_palin;
+    }
+    __atomic_add_fetch(&shmem->dedup_misses, 1, __ATOMIC_RELAXED);
+    is_palin = check(word, length);
+    dedup_insert(shmem_dedup(shmem), shmem->dedup_slots, hash, tag, is_palin);
+    return is_palin;
+}
+
+// Returns the start of word i inside the mapped infile (not null-terminated)
+inline const char* shmem_word(struct Shmem* shmem, const char* map, int i) {
+    return map + shmem_offsets(shmem)[i];
+}
+
+// Returns the length of word i, not counting its newline
+inline int shmem_length(struct Shmem* shmem, int i) {
+    return (int) (shmem_offsets(shmem)[i+1] - shmem_offsets(shmem)[i] - 1);
+}
+
 #endif
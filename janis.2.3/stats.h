@@ -0,0 +1,31 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: stats.h
+*/
+
+/* Live counters for one worker slot (a palin, or a thread with [-T]). Every slot is on its
+   own cache line and only its worker ever writes it, so the workers don't bounce lines
+   between CPUs and don't need atomic adds. Master can read them at any time (SIGUSR1)
+   without stopping anybody; each counter is read whole, the set of them may be a word
+   apart. The times tell whether a run is spent in the check itself or on the critical
+   section: waiting for the lock, or holding it. */
+struct WorkerStats {
+    unsigned long words; // Words (lines) checked
+    unsigned long palins; // How many of them were palindromes
+    unsigned long bytes; // Bytes of those words
+    unsigned long check_ns; // Time in the check (or the analysis)
+    unsigned long wait_ns; // Time waiting to get into the critical section
+    unsigned long hold_ns; // Time inside the critical section
+} __attribute__((aligned(64)));
+
+// Adds to a counter of the calling worker's own slot
+inline void stats_add(unsigned long* counter, unsigned long value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TIMEPAGE_H
+#define TIMEPAGE_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: timepage.h
+*/
+
+#include <string.h>
+#include <time.h>
+
+#define TIME_TEXT 16 // "hh:mm:ss AM" plus its null, rounded up to two 8-byte words
+#define TIME_TICK_MS 10 // How often master's clock thread looks at the time
+
+/* The current time, already formatted, published in shared memory by master (like the
+   kernel's vDSO page). A thread in master refreshes it whenever the second changes, and
+   palin copies it out instead of calling time()/localtime()/strftime() for every line.
+   It is guarded by a sequence lock: seq is odd while master is rewriting it, and a reader
+   that saw seq change (or saw it odd) while copying simply copies it again. */
+struct TimePage {
+    unsigned int seq;
+    long stamp; // Seconds since the epoch the text was formatted from, 0 before the first tick
+    unsigned long text[TIME_TEXT / sizeof(unsigned long)]; // "hh:mm:ss AM", copied as whole words
+};
+
+// Master only: formats "seconds" into the page
+inline void timepage_publish(struct TimePage* page, time_t seconds) {
+    char text[TIME_TEXT] = {0};
+    struct tm formatted;
+    strftime(text, sizeof(text), "%I:%M:%S %p", localtime_r(&seconds, &formatted));
+    unsigned long words[TIME_TEXT / sizeof(unsigned long)];
+    memcpy(words, text, sizeof(words));
+
+    unsigned int seq = page->seq;
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED); // Odd: readers retry
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&page->stamp, (long) seconds, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < TIME_TEXT / sizeof(unsigned long); i++)
+        __atomic_store_n(&page->text[i], words[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE); // Even again: the page is whole
+}
+
+// Copies the formatted time into "text" (TIME_TEXT bytes) and returns the seconds it
+// stands for, or returns 0 without touching "text" if master hasn't published one yet
+inline long timepage_read(const struct TimePage* page, char* text) {
+    unsigned long words[TIME_TEXT / sizeof(unsigned long)];
+    unsigned int before, after;
+    long stamp;
+    do {
+        before = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        stamp = __atomic_load_n(&page->stamp, __ATOMIC_RELAXED);
+        for (size_t i = 0; i < TIME_TEXT / sizeof(unsigned long); i++)
+            words[i] = __atomic_load_n(&page->text[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+    if (stamp != 0)
+        memcpy(text, words, TIME_TEXT);
+    return stamp;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+#
+# Author: Daniel Janis
+# Program: Project 2 - CS 4760-002
+# Date: 10/8/20
+# File: tools/gen_casefold.py
+# Purpose:
+#  Writes casefold.cpp, the case folding and skip tables behind casefold_entry() in utf8.h.
+#  Run it from janis.2.3:
+#
+#      python3 tools/gen_casefold.py [CaseFolding.txt] > casefold.cpp
+#
+#  The general categories come from Python's unicodedata. The simple case foldings come
+#  from CaseFolding.txt when one is given (https://www.unicode.org/Public/14.0.0/ucd/), or
+#  else from Perl's Unicode::UCD, which ships the same file. Both have to be Unicode
+#  UNICODE_VERSION, so the tables don't end up half one version and half another.
+
+import subprocess
+import sys
+import unicodedata
+
+UNICODE_VERSION = "14.0.0"
+BLOCK = 128 # CASEFOLD_BLOCK in utf8.h
+CODE_POINTS = 0x110000
+SPACES = (0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x85) # Skipped controls: the ASCII whitespace and NEL
+
+HEADER = """/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: casefold.cpp
+    Purpose:
+     The tables behind casefold_entry() in utf8.h, for Unicode %s. For every code point
+     they hold its simple case folding (the C and S lines of CaseFolding.txt, so one code
+     point always folds to one code point) and whether the UTF-8 check skips it: general
+     categories P (punctuation), S (symbols) and Z (separators), plus the ASCII whitespace
+     controls and NEL. On ASCII that is exactly what ispunct() and isspace() skip in the
+     "C" locale.
+
+     casefold_stage1 picks one of the distinct %d-code-point blocks for every block of
+     code points, casefold_stage2 has the kind of every code point in it, and
+     casefold_kind turns a kind into (fold delta * 2) | skip. Most of Unicode shares a
+     handful of blocks, so the whole thing is about 30 KB.
+
+     Made by tools/gen_casefold.py, do not edit by hand. To make it again (from janis.2.3):
+         python3 tools/gen_casefold.py [CaseFolding.txt] > casefold.cpp
+
+*/
+
+#include "utf8.h"
+"""
+
+
+def fail(message):
+    sys.stderr.write("gen_casefold.py: Error: %s\n" % message)
+    sys.exit(1)
+
+
+# Simple foldings from CaseFolding.txt: "code; status; mapping; # name", status C and S only
+# (F is the full folding to more than one code point, T the Turkic one)
+def folds_from_file(path):
+    folds = {}
+    version = None
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            if version is None and line.startswith("# CaseFolding-"):
+                version = line[len("# CaseFolding-"):].split(".txt")[0]
+            line = line.split("#")[0].strip()
+            if not line:
+                continue
+            code, status, mapping = [field.strip() for field in line.split(";")[:3]]
+            if status in ("C", "S"):
+                folds[int(code, 16)] = int(mapping, 16)
+    if version != UNICODE_VERSION:
+        fail("%s is CaseFolding-%s, not %s" % (path, version, UNICODE_VERSION))
+    return folds
+
+
+# Simple foldings from Perl's Unicode::UCD, as "code mapping" lines in hex
+def folds_from_perl():
+    script = ("use Unicode::UCD qw(all_casefolds); print Unicode::UCD::UnicodeVersion(), \"\\n\";"
+              "my $f = all_casefolds(); for my $cp (sort { $a <=> $b } keys %$f) {"
+              " my $s = $f->{$cp}{simple}; printf \"%X %s\\n\", $cp, $s if length $s && $s !~ / /; }")
+    try:
+        lines = subprocess.run(["perl", "-e", script], check=True, capture_output=True, text=True).stdout.split("\n")
+    except (OSError, subprocess.CalledProcessError) as e:
+        fail("cannot get the foldings from Unicode::UCD (%s), pass CaseFolding.txt instead" % e)
+    if lines[0] != UNICODE_VERSION:
+        fail("Unicode::UCD is Unicode %s, not %s" % (lines[0], UNICODE_VERSION))
+    folds = {}
+    for line in lines[1:]:
+        if line:
+            code, mapping = line.split()
+            folds[int(code, 16)] = int(mapping, 16)
+    return folds
+
+
+# Lines of "per" values, indented by "indent"
+def rows(values, per, indent):
+    return "\n".join(indent + ", ".join("%d" % v for v in values[i:i + per]) + ","
+                     for i in range(0, len(values), per))
+
+
+def main():
+    if unicodedata.unidata_version != UNICODE_VERSION:
+        fail("Python's unicodedata is Unicode %s, not %s" % (unicodedata.unidata_version, UNICODE_VERSION))
+    folds = folds_from_file(sys.argv[1]) if len(sys.argv) > 1 else folds_from_perl()
+
+    # What every code point turns into: (fold delta * 2) | skip
+    entries = []
+    for cp in range(CODE_POINTS):
+        skip = unicodedata.category(chr(cp))[0] in "PSZ" or cp in SPACES
+        entries.append((folds.get(cp, cp) - cp) * 2 + (1 if skip else 0))
+    # Kind 0 is "nothing to do", so casefold_entry() can return 0 past the code points
+    kinds = sorted(set(entries), key=lambda entry: (entry != 0, entry))
+    kind = {entry: i for i, entry in enumerate(kinds)}
+
+    blocks = {} # Distinct blocks of kinds, in order of first use
+    stage1 = []
+    for start in range(0, CODE_POINTS, BLOCK):
+        block = tuple(kind[entry] for entry in entries[start:start + BLOCK])
+        stage1.append(blocks.setdefault(block, len(blocks)))
+    if len(kinds) > 256 or len(blocks) > 256:
+        fail("%d kinds and %d blocks don't fit the unsigned char tables" % (len(kinds), len(blocks)))
+
+    out = [HEADER % (UNICODE_VERSION.rsplit(".0", 1)[0], BLOCK)]
+    out.append("const int casefold_kind[%d] = {\n%s\n};\n" % (len(kinds), rows(kinds, 10, "    ")))
+    out.append("const unsigned char casefold_stage1[%d] = {\n%s\n};\n" % (len(stage1), rows(stage1, 20, "    ")))
+    out.append("const unsigned char casefold_stage2[%d][CASEFOLD_BLOCK] = {" % len(blocks))
+    for block in blocks: # Dicts keep insertion order, so this is block 0, 1, ...
+        out.append("    {\n%s\n    }," % rows(list(block), 20, "        "))
+    out.append("};\n")
+    sys.stdout.write("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 2 - Practice Shared Memory and IPC - CS 4760-002
+    Date: 10/8/20
+    File: uring.cpp
+    Purpose:
+     A small io_uring for master's output files. master's drain thread hands a full buffer
+     to the kernel with uring_write() and carries on collecting lines in the other one while
+     it is written; uring_submit() passes everything queued since the last call to the kernel
+     in one io_uring_enter() system call, so flushing all the output files at once costs one
+     system call instead of one write() each. uring_reap() picks up the results.
+
+     The queues are the kernel's ring buffers mapped into master: we fill in a submission
+     entry, publish it by moving the submission tail, and the kernel publishes the result by
+     moving the completion tail. If io_uring_setup() fails (kernels before 5.1, or io_uring
+     turned off) fd stays -1 and master writes the files itself.
+
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+// Sets up the rings with room for "entries" writes, returns false if io_uring isn't there
+bool uring_init(struct Uring* uring, unsigned entries) {
+    memset(uring, 0, sizeof(*uring));
+    uring->fd = -1;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return false;
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP; // Both rings in one mapping (5.4+)
+    if (single && uring->cq_ring_size > uring->sq_ring_size)
+        uring->sq_ring_size = uring->cq_ring_size;
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    uring->cq_ring = uring->sq_ring;
+    if (!single) {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED) {
+            munmap(uring->sq_ring, uring->sq_ring_size);
+            close(fd);
+            return false;
+        }
+    }
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe*) mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+        if (!single)
+            munmap(uring->cq_ring, uring->cq_ring_size);
+        close(fd);
+        return false;
+    }
+
+    char* sq = (char*) uring->sq_ring;
+    char* cq = (char*) uring->cq_ring;
+    uring->sq_head = (unsigned*) (sq + params.sq_off.head);
+    uring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    uring->sq_array = (unsigned*) (sq + params.sq_off.array);
+    uring->sq_mask = *(unsigned*) (sq + params.sq_off.ring_mask);
+    uring->cq_head = (unsigned*) (cq + params.cq_off.head);
+    uring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    uring->cq_mask = *(unsigned*) (cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    uring->fd = fd;
+    return true;
+}
+
+// Unmaps the rings and closes the instance, writes still in flight finish on their own
+void uring_exit(struct Uring* uring) {
+    if (uring->fd == -1)
+        return;
+    munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring != uring->sq_ring)
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    munmap(uring->sq_ring, uring->sq_ring_size);
+    close(uring->fd);
+    uring->fd = -1;
+}
+
+// Queues a write of "length" bytes from "buf" to "fd" at its current position (the end,
+// for files opened with O_APPEND). "tag" comes back with the result. Returns false if the
+// submission queue is full, nothing is queued then.
+bool uring_write(struct Uring* uring, int fd, const void* buf, unsigned length, unsigned long tag) {
+    unsigned tail = *uring->sq_tail; // Only we move the tail
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) > uring->sq_mask)
+        return false;
+    unsigned index = tail & uring->sq_mask;
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long) buf;
+    sqe->len = length;
+    sqe->off = (unsigned long) -1; // The file position, not an offset
+    sqe->user_data = tag;
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE); // The kernel may read it from here on
+    uring->queued++;
+    return true;
+}
+
+// Hands everything queued to the kernel and waits until at least "wait" results are in, in
+// one system call. Returns how many were submitted, or -1 with errno set.
+int uring_submit(struct Uring* uring, unsigned wait) {
+    unsigned flags = (wait > 0) ? IORING_ENTER_GETEVENTS : 0;
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, uring->fd, uring->queued, wait, flags, NULL, 0);
+    } while (submitted == -1 && errno == EINTR);
+    if (submitted > 0)
+        uring->queued -= submitted;
+    return submitted;
+}
+
+// Takes the next result off the completion queue, the tag given to uring_write() goes in
+// *tag and the bytes written (or -errno) in *result. Returns false if there is none yet.
+bool uring_reap(struct Uring* uring, unsigned long* tag, int* result) {
+    unsigned head = *uring->cq_head; // Only we move the head
+    if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+    struct io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+    *tag = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE); // The kernel may reuse the entry
+    return true;
+}
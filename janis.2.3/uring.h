@@ -0,0 +1,43 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: uring.h
+*/
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 8 // Submission queue size, one write in flight per output file fits easily
+
+// An io_uring instance set up with the raw system calls (no liburing), only used by the
+// thread writing the output files
+struct Uring {
+    int fd; // -1 if the kernel doesn't have io_uring (or won't let us use it)
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring; // Same as sq_ring when the kernel maps both rings at once
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned queued; // Writes queued since the last uring_submit()
+};
+
+bool uring_init(struct Uring*, unsigned);
+void uring_exit(struct Uring*);
+bool uring_write(struct Uring*, int, const void*, unsigned, unsigned long);
+int uring_submit(struct Uring*, unsigned);
+bool uring_reap(struct Uring*, unsigned long*, int*);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+/*
+Author: Daniel Janis
+Program: Project 2 - CS 4760-002
+Date: 10/8/20
+File: utf8.h
+*/
+
+#include <stddef.h>
+
+/* UTF-8 decoding for the [-u] check. A line is split into characters from the front with
+   utf8_next() and from the back with utf8_prev(), which always split it the same way: a
+   valid sequence (shortest form, no surrogates, at most U+10FFFF) is one character, and
+   every byte that isn't part of one is a character of its own, UTF8_INVALID + the byte,
+   which nothing folds to or skips. */
+
+#define UTF8_INVALID 0x110000 // First value past the code points, for bytes that aren't valid UTF-8
+#define CASEFOLD_BLOCK 128 // Code points per block of the case folding tables
+
+extern const int casefold_kind[];
+extern const unsigned char casefold_stage1[];
+extern const unsigned char casefold_stage2[][CASEFOLD_BLOCK];
+
+// Length of the valid UTF-8 sequence at "s" that fits in "avail" bytes, its code point goes in
+// *cp. Returns 0 if there isn't one.
+inline int utf8_sequence(const unsigned char* s, size_t avail, unsigned int* cp) {
+    unsigned char c = s[0];
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    }
+    int length;
+    unsigned int value, least; // Smaller values would be overlong
+    if (c >= 0xC2 && c <= 0xDF) {
+        length = 2;
+        value = c & 0x1F;
+        least = 0x80;
+    }
+    else if ((c & 0xF0) == 0xE0) {
+        length = 3;
+        value = c & 0x0F;
+        least = 0x800;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        length = 4;
+        value = c & 0x07;
+        least = 0x10000;
+    }
+    else
+        return 0;
+    if ((size_t) length > avail)
+        return 0;
+    for (int k = 1; k < length; k++) {
+        if ((s[k] & 0xC0) != 0x80)
+            return 0;
+        value = (value << 6) | (s[k] & 0x3F);
+    }
+    if (value < least || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+        return 0;
+    *cp = value;
+    return length;
+}
+
+// Decodes the character at the front of [lo, hi) and moves lo past it
+inline unsigned int utf8_next(const unsigned char*& lo, const unsigned char* hi) {
+    unsigned int cp;
+    int length = utf8_sequence(lo, hi - lo, &cp);
+    if (length == 0) {
+        cp = UTF8_INVALID + *lo;
+        length = 1;
+    }
+    lo += length;
+    return cp;
+}
+
+// Decodes the character at the back of [lo, hi) and moves hi back past it. A valid sequence
+// can only start on its lead byte, so whatever ends at hi is what utf8_next() would find.
+inline unsigned int utf8_prev(const unsigned char* lo, const unsigned char*& hi) {
+    unsigned int cp = hi[-1];
+    if (cp < 0x80) {
+        hi--;
+        return cp;
+    }
+    for (int length = 2; length <= 4 && hi - lo >= length; length++) {
+        if ((hi[-length] & 0xC0) != 0x80) { // The lead byte, valid or not it is the only one
+            if (utf8_sequence(hi - length, length, &cp) == length) {
+                hi -= length;
+                return cp;
+            }
+            break;
+        }
+    }
+    hi--;
+    return UTF8_INVALID + *hi;
+}
+
+// Looks the code point up in the case folding tables (casefold.cpp), pass the result to
+// casefold_skipped() and casefold_apply()
+inline int casefold_entry(unsigned int cp) {
+    if (cp >= UTF8_INVALID)
+        return 0;
+    return casefold_kind[casefold_stage2[casefold_stage1[cp / CASEFOLD_BLOCK]][cp % CASEFOLD_BLOCK]];
+}
+
+// Punctuation, symbols, separators and spaces, the [-u] check ignores these
+inline bool casefold_skipped(int entry) {
+    return entry & 1;
+}
+
+// The simple case folding of cp
+inline unsigned int casefold_apply(unsigned int cp, int entry) {
+    return cp + (entry >> 1);
+}
+
+#endif
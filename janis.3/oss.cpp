@@ -16,24 +16,33 @@
 
         There is also a limit on the number of concurrent children allowed to be executing
         at once. Two message queues are used to protect the critical region, allowing only
-        one child to be execute inside that critical region at once. Inside of OSS's critical
-        region, the shared clock gets incremented by 100 nanoseconds.
-
-        Once a message is received, and the child's PID has been consumed, a new child is
-        allowed to enter the critical section. This continues until the criteria for termination
-        is reached, as explaiend above.
+        one child to be execute inside that critical region at once.
+
+        The clock is event driven: every child, once started, picks the time it terminates
+        and sleeps until then with sim_nanosleep() (simclock.cpp), which writes the time into
+        a timer slot in shared memory and sleeps on a futex. OSS waits (on a futex as well)
+        until every child it started has registered, keeps the times in a min-heap, and
+        instead of ticking the clock forward a little at a time it jumps the clock straight to
+        the earliest one and wakes only that child. The child leaves the critical section,
+        puts its PID in shmPID and tells OSS (MSG_LEAVING), and a new child is started in its
+        place. A sleeping child costs no messages and no CPU, however far away its time is.
+        This continues until the criteria for termination is reached, as explaiend above.
 
 */
 
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <string.h>
+#include <queue>
+#include <vector>
+#include <functional>
 #include "oss.h"
 #include "shared.h"
 
 int ch_limit = 5; // number of concurrent children allowed to exist in the system at the same time [-s x] (Default: 5)
 int timer = 20; // time in seconds after which the process will terminate, even if it has not finished [-t time] (Default: 100)
 int pr_count = 0; // Current running total of children processes present
+int unregistered = 0; // Children started that haven't registered their timer yet
 
 struct Shmem* shmem; // struct instance used for shared memory
 struct Msgbuf buf1, buf2; // struct instance used for message queue
@@ -44,6 +53,20 @@ int sid; // Shared memory segment ID
 key_t mkey_send, mkey_rec; // Unique key for using message queue
 int mqid_send, mqid_rec; // Message queue ID
 
+// A child's time to terminate on the shared clock
+struct Event {
+    long long time; // In nanoseconds
+    int slot; // Its timer slot in shared memory
+    bool operator>(const struct Event& other) const {
+        return time > other.time;
+    }
+};
+
+// Pending terminations, the earliest on top
+std::priority_queue<struct Event, std::vector<struct Event>, std::greater<struct Event> > events;
+
+#define END_TIME 2000000000LL // The simulation stops when the clock reaches 2 seconds
+
 int main(int argc, char *argv[]) {
 
     signal(SIGINT, sig_handle); // Sets the signal to use my signal handler function
@@ -184,12 +207,13 @@ int main(int argc, char *argv[]) {
     // Initialize the shared memory int that indicates when child processes terminate
     shmem->shmPID = 0; // When this is 0, a child process is allowed to run
     // When this is a positive value, a child process has recently terminated
+
+    memset(&shmem->timers, 0, sizeof(shmem->timers)); // Every timer slot starts out TIMER_FREE
     
     //////////////////////////////////////////////////////////////////////////////////////////
     /* fork off appropriate number of child processes until the termination criteria is met */
     //////////////////////////////////////////////////////////////////////////////////////////
  
-    pid_t childpid; // child process to be
     int running_procs = 0;
 
     FILE *fptr;
@@ -197,104 +221,128 @@ int main(int argc, char *argv[]) {
 
     // This forks the number of concurrent children allowed in the system at once
     for (int i = 0; i < ch_limit; i++) {
-        childpid = fork(); // Returns 0 if child created, 
-        if (childpid == 0) { // Returns to the newly creates child process
-            if (running_procs == 0) { // CREATES A PROCESS GROUP FOR LATER (Safely terminate all children on CTRL+C)
-                shmem->pgid = getpid();
-            }
-            setpgid(0, shmem->pgid); // sets the PGID of the process to the shmem process ID
-            execl("./user", NULL); // Execute the "user" executable on the new child process
-            error_msg = exe_name + ": Error: Failed to execl";
-            perror(error_msg.c_str());
-            exit(EXIT_FAILURE);   
-        }   
-        if (childpid < 0) {
-            error_msg = exe_name + ": Error: Failed to fork a child";
+        spawn_child(fptr, running_procs, exe_name);
+        ++running_procs; // a new process is now running, keep track of how many are also running
+    }
+    running_procs -= collect_timers(); // Every child's time to terminate has to be known before the clock moves
+    while(!events.empty()) {
+        // CRITICAL SECTION FROM OSS (move the clock to the next child's time to terminate)
+        struct Event next = events.top();
+        events.pop();
+        if (next.time >= END_TIME) { // When 2 seconds elapsed would pass first,
+            set_clock(END_TIME);
+            fprintf(stderr, "[OSS]: 2 seconds have passed in the simulated system, interrupting processes!\n");
+            fclose(fptr);
+            sig_handle(SIGTERM);
+        }
+        if (next.time > clock_time()) // Nothing happens in between, skip right to it
+            set_clock(next.time);
+
+        sim_fire(shmem, next.slot); // Wake only that child, the others keep sleeping until their own turn
+        if (msgrcv(mqid_rec, &buf2, MSG_SIZE, OSS_MTYPE, 0) == -1) { // RECEIVE a message from USER in OSS, leave the critical region
+            error_msg = "oss: msgrcv: Error: Message was not received";
             perror(error_msg.c_str());
             exit(EXIT_FAILURE);
         }
-        fprintf(fptr, "OSS: Creating new child pid %d at system clock time %d.%09d\n", childpid, shmem->sec, shmem->nanosec);
-        //fprintf(stderr, "OSS: Creating new child pid %d at system clock time %d.%09d\n", childpid, shmem->sec, shmem->nanosec);
-        ++pr_count; // a process has been started, total counter incremented
-        ++running_procs; // a new process is now running, keep track of how many are also running 
-    }
-    while(1) {
         if (shmem->shmPID != 0) { // Back in the parent and the PID of the child was set, (MEANING: child has terminated)
-            //fprintf(stderr, "[OSS] process counter: %d\n", pr_count);
-   
+
             /* LOG THAT THE CHILD PROC HAS TERMINATED AT THE TIME ON SHARED CLOCK */
-              
+
             fprintf(fptr, "OSS: Child pid %d is terminating at system clock time %d.%09d\n", shmem->shmPID, shmem->sec, shmem->nanosec);
-            //fprintf(stderr, "OSS: Child pid %d is terminating at system clock time %d.%09d\n", shmem->shmPID, shmem->sec, shmem->nanosec);
-            
             waitpid(shmem->shmPID, NULL, 0);
             shmem->shmPID = 0;
             --running_procs;
-        } 
-        // CRITICAL SECTION FROM OSS (increment the OSS clock by constant nanoseconds value)
-        else { // Inrement timer because child process is still executing
-            shmem->nanosec += 1100; // Increment nanoseconds by 100
-            if (shmem->nanosec >= 1000000000) { // If nanoseconds can be converted to seconds,
-               shmem->nanosec -= 1000000000; // this takes care of conversions
-               shmem->sec += 1;
-            }
-            if (shmem->sec >= 2) { // When 2 seconds elapsed has passed,
-                //fprintf(stderr, "[OSS] elapsed time: %d.%09d seconds\n", shmem->sec, shmem->nanosec);
-                fprintf(stderr, "[OSS]: 2 seconds have passed in the simulated system, interrupting processes!\n");
-                sig_handle(SIGTERM);
-                break;
-            }
         }
 
         // If the process count is 100, send a signal to terminate all children and itself
-        if (pr_count >= 100 && running_procs <= ch_limit-1) { // HAVE WE HIT THE LIMIT OF 100 PROCESSES
-            fprintf(stderr, "[OSS]: 100 total children processes reached, interrupting processes!\n", pr_count, running_procs);
+        if (pr_count >= 100) { // HAVE WE HIT THE LIMIT OF 100 PROCESSES
+            fprintf(stderr, "[OSS]: 100 total children processes reached, interrupting processes!\n");
+            fclose(fptr);
             sig_handle(SIGTERM);
-            break;
         }
-        // If there are less processes than the concurrent limit running and less than 100 total processes, spawn children
-        if ((running_procs < ch_limit) && (pr_count < 100)) {
-            childpid = fork(); // Returns 0 if child created, 
-            if (childpid == 0) { // Returns to the newly creates child process
-                if (running_procs == 0/*ch_limit == 1*/) { // If only one concurrent process was allowed, this makes sure it can terminate successfully
-                    shmem->pgid = getpid();
-                }
-                setpgid(0, shmem->pgid); // sets the PGID of the process to the shmem process ID
-                execl("./user", NULL); // Execute the "user" executable on the new child process
-                error_msg = exe_name + ": Error: Failed to execl";
-                perror(error_msg.c_str());
-                --pr_count; // If execl failed, allow another process to try to start
-                exit(EXIT_FAILURE);
-            }
-            if (childpid < 0) {
-                error_msg = exe_name + ": Error: Failed to fork a child";
-                perror(error_msg.c_str());
-                exit(EXIT_FAILURE);
-            }
-            fprintf(fptr, "OSS: Creating new child pid %d at system clock time %d.%09d\n", childpid, shmem->sec, shmem->nanosec);
-            //fprintf(stderr, "OSS: Creating new child pid %d at system clock time %d.%09d\n", childpid, shmem->sec, shmem->nanosec);
+        // A child left, start another in its place
+        spawn_child(fptr, running_procs, exe_name);
+        ++running_procs;
+        running_procs -= collect_timers();
+    }
+    fclose(fptr);
+    free_memory(); // Clears all shared memory
+    return 0;
+}
 
-            ++pr_count; // a process has been started, total counter incremented
-            ++running_procs; // a new process is now running, keep track of how many are also running
+// Forks and execs a USER and starts it, its time to terminate comes in with collect_timers()
+void spawn_child(FILE* fptr, int running_procs, std::string exe_name) {
+    std::string error_msg;
+    pid_t childpid = fork(); // Returns 0 if child created,
+    if (childpid == 0) { // Returns to the newly creates child process
+        if (running_procs == 0) { // CREATES A PROCESS GROUP FOR LATER (Safely terminate all children on CTRL+C)
+            shmem->pgid = getpid();
         }
+        setpgid(0, shmem->pgid); // sets the PGID of the process to the shmem process ID
+        execl("./user", "user", (char*) NULL); // Execute the "user" executable on the new child process
+        error_msg = exe_name + ": Error: Failed to execl";
+        perror(error_msg.c_str());
+        sim_failed(shmem); // OSS is waiting for a USER to register, tell it there won't be one
+        exit(EXIT_FAILURE);
+    }
+    if (childpid < 0) {
+        error_msg = exe_name + ": Error: Failed to fork a child";
+        perror(error_msg.c_str());
+        exit(EXIT_FAILURE);
+    }
+    fprintf(fptr, "OSS: Creating new child pid %d at system clock time %d.%09d\n", childpid, shmem->sec, shmem->nanosec);
+    ++pr_count; // a process has been started, total counter incremented
+
+    static int count = 1;
+    buf1.mtype = childpid;
+    buf1.mflag = MSG_START;
+    buf1.seed = count++; // Sends a different seed everytime (used for the seeding the random generator in USER)
+    if (msgsnd(mqid_send, &buf1, MSG_SIZE, 0) < 0) {
+        error_msg = exe_name + ": Error: msgsnd: the message did not send";
+        perror(error_msg.c_str());
+        exit(EXIT_FAILURE);
+    }
+    ++unregistered;
+}
 
-        static int count = 1;
-        buf1.mflag = count; // Sends a different flag everytime (used for the seeding the random generator in USER)
-        count++;
-        if (msgsnd(mqid_send, &buf1, sizeof(buf1), IPC_NOWAIT) < 0) { // SEND a message from OSS to USER, enter the critical region
-            error_msg = exe_name + ": Error: msgsnd: the message did not send";
-            perror(error_msg.c_str());
-            exit(EXIT_FAILURE);
-        }
-        if (msgrcv(mqid_rec, &buf2, sizeof(buf2), 0, 0) == -1) { // RECEIVE a message from USER in OSS, leave the critical region
-            error_msg = "oss: msgrcv: Error: Message was not received";
-            perror(error_msg.c_str());
-            exit(EXIT_FAILURE);
+// Sleeps until every started child has registered its timer, and puts their times to
+// terminate into the heap. Returns how many of them failed to start (and are gone).
+int collect_timers() {
+    int failed = 0;
+    while (unregistered > 0) {
+        int seen = sim_seq(shmem); // Anything that registers after this wakes sim_wait() below
+        for (int i = 0; i < MAX_TIMERS; i++) {
+            struct Timer* timer = &shmem->timers.slot[i];
+            int state = __atomic_load_n(&timer->state, __ATOMIC_ACQUIRE);
+            if (state == TIMER_ARMED) {
+                struct Event event = {timer->sec * 1000000000LL + timer->nanosec, i};
+                events.push(event);
+                __atomic_store_n(&timer->state, TIMER_QUEUED, __ATOMIC_RELEASE);
+                --unregistered;
+            }
+            else if (state == TIMER_FAILED) {
+                waitpid(timer->pid, NULL, 0);
+                __atomic_store_n(&timer->state, TIMER_FREE, __ATOMIC_RELEASE);
+                --pr_count; // If execl failed, allow another process to try to start
+                --unregistered;
+                ++failed;
+            }
         }
+        if (unregistered > 0)
+            sim_wait(shmem, seen);
     }
-    fclose(fptr);
-    free_memory(); // Clears all shared memory
-    return 0;
+    return failed;
+}
+
+// The shared clock in nanoseconds
+long long clock_time() {
+    return shmem->sec * 1000000000LL + shmem->nanosec;
+}
+
+// Moves the shared clock to "time" nanoseconds
+void set_clock(long long time) {
+    shmem->sec = time / 1000000000LL;
+    shmem->nanosec = time % 1000000000LL;
 }
 
 // Kills all child processes and terminates, and prints a log to log file and frees shared memory
@@ -8,8 +8,13 @@ Date: 10/20/20
 File: oss.h
 */
 
+#include <stdio.h>
 #include <string>
 
+void spawn_child(FILE*, int, std::string);
+int collect_timers();
+long long clock_time();
+void set_clock(long long);
 void sig_handle(int);
 void countdown_to_interrupt(int, std::string);
 void clock(int, std::string);
@@ -18,17 +18,29 @@ File: shared.h
 #include <sys/stat.h>
 #include <sys/shm.h>
 #include <sys/msg.h>
+#include "simclock.h"
 
 struct Shmem {
     int sec; // holds seconds
     int nanosec; // holds nanoseconds
     int shmPID; // Indicate when child processes have terminated
     int pgid; // Holds the process group ID, for termination
+    struct TimerList timers; // Children sleeping until a time on the clock (sim_nanosleep())
 };
 
+#define OSS_MTYPE 1 // mtype of messages to OSS, messages to a USER have its PID as mtype
+
+// What a message says (mflag)
+#define MSG_START 1 // OSS to USER: you are running, "seed" seeds your random numbers
+#define MSG_LEAVING 2 // USER to OSS: I have left, my PID is in shmPID
+
 struct Msgbuf {
-    //int mtype; // Holds the type
+    long mtype; // Who the message is for, msgsnd()/msgrcv() need this first
     int mflag; // stores the message for message queue
+    int seed; // MSG_START
+    pid_t pid; // Child the message is from
 };
 
+#define MSG_SIZE (sizeof(struct Msgbuf) - sizeof(long)) // Size msgsnd()/msgrcv() want, without mtype
+
 #endif
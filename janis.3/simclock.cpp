@@ -0,0 +1,105 @@
+/*
+
+	Author: Daniel Janis
+	Program: Project 3 - Message Passing and Operating System Simulator - CS 4760-002
+	Date: 10/20/20
+    File: simclock.cpp
+	Purpose:
+
+        Sleeping on the simulated clock. A USER calls sim_nanosleep() with how long it wants to
+        sleep on the shared memory clock, like nanosleep() does on the real one. It takes a free
+        timer slot in shared memory, writes down when it wakes, and sleeps on a futex (the slot's
+        state word) inside the kernel, so a sleeping child uses no CPU and sends no messages.
+
+        OSS sleeps on the futex of the list's "seq" counter until every child it started has
+        registered (sim_seq() and sim_wait()), takes the new deadlines into its min-heap, moves
+        the clock to the earliest one and wakes only the child it belongs to (sim_fire()).
+
+        The futexes are the shared kind (no FUTEX_PRIVATE_FLAG): OSS and USER are different
+        processes with the segment attached at different addresses, and the kernel finds the
+        sleepers by the shared memory page, not by the address.
+
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shared.h"
+
+// Sleeps while *word is still "value" (returns right away if it isn't)
+void futex_wait(int* word, int value) {
+    syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+// Wakes everyone sleeping on *word
+void futex_wake(int* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Tells OSS something changed in the timer list
+void sim_notify(struct Shmem* shmem) {
+    __atomic_add_fetch(&shmem->timers.seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&shmem->timers.seq);
+}
+
+// Takes a free slot for this process, -1 if there is none
+int sim_claim(struct Shmem* shmem) {
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        int expected = TIMER_FREE;
+        if (__atomic_compare_exchange_n(&shmem->timers.slot[i].state, &expected, TIMER_ARMING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            shmem->timers.slot[i].pid = getpid();
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Sleeps until the shared clock is "nanoseconds" past where it is now. Returns 0 once OSS has
+// moved the clock there, or -1 (errno EAGAIN) if every timer slot is taken.
+int sim_nanosleep(struct Shmem* shmem, long nanoseconds) {
+    int i = sim_claim(shmem);
+    if (i == -1) {
+        errno = EAGAIN;
+        return -1;
+    }
+    struct Timer* timer = &shmem->timers.slot[i];
+    // OSS doesn't move the clock while a child it started hasn't registered yet, so it holds still here
+    long long wake = shmem->sec * 1000000000LL + shmem->nanosec + nanoseconds;
+    timer->sec = wake / 1000000000LL;
+    timer->nanosec = wake % 1000000000LL;
+    __atomic_store_n(&timer->state, TIMER_ARMED, __ATOMIC_RELEASE);
+    sim_notify(shmem);
+
+    int state;
+    while ((state = __atomic_load_n(&timer->state, __ATOMIC_ACQUIRE)) != TIMER_FIRED)
+        futex_wait(&timer->state, state); // Also comes back on a signal, or if OSS just queued it
+    __atomic_store_n(&timer->state, TIMER_FREE, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// For a child whose execl() failed: tells OSS that no USER will register, it waits for this one
+void sim_failed(struct Shmem* shmem) {
+    int i = sim_claim(shmem);
+    if (i == -1)
+        return;
+    __atomic_store_n(&shmem->timers.slot[i].state, TIMER_FAILED, __ATOMIC_RELEASE);
+    sim_notify(shmem);
+}
+
+// The change counter, read it before looking through the slots and hand it to sim_wait()
+int sim_seq(struct Shmem* shmem) {
+    return __atomic_load_n(&shmem->timers.seq, __ATOMIC_ACQUIRE);
+}
+
+// Sleeps (OSS) until a child changes the timer list after sim_seq() returned "seen"
+void sim_wait(struct Shmem* shmem, int seen) {
+    futex_wait(&shmem->timers.seq, seen);
+}
+
+// Wakes the child sleeping on slot i, the clock has reached its time
+void sim_fire(struct Shmem* shmem, int i) {
+    __atomic_store_n(&shmem->timers.slot[i].state, TIMER_FIRED, __ATOMIC_RELEASE);
+    futex_wake(&shmem->timers.slot[i].state);
+}
@@ -0,0 +1,43 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+/*
+Author: Daniel Janis
+Program: Project 3 - CS 4760-002
+Date: 10/20/20
+File: simclock.h
+*/
+
+#define MAX_TIMERS 32 // Timer slots in shared memory, more than the 27 children that can run at once
+
+// What a timer slot is doing (Timer.state), a child and OSS hand it back and forth
+#define TIMER_FREE 0 // Nobody is using it
+#define TIMER_ARMING 1 // A child took it and is writing its deadline
+#define TIMER_ARMED 2 // The deadline is written, OSS hasn't seen it yet
+#define TIMER_QUEUED 3 // OSS has it in its heap, the child sleeps until it fires
+#define TIMER_FIRED 4 // The clock reached the deadline, the child can go
+#define TIMER_FAILED 5 // execl() failed, there is no USER to sleep (pid is the child to wait for)
+
+// One sleeping child
+struct Timer {
+    int state; // TIMER_*, also the futex word the child sleeps on
+    pid_t pid; // Child that owns it
+    int sec; // When it wakes on the shared clock
+    int nanosec;
+};
+
+// Every child's timer, kept in shared memory
+struct TimerList {
+    int seq; // Goes up on every change OSS should look at, OSS sleeps on it as a futex word
+    struct Timer slot[MAX_TIMERS];
+};
+
+struct Shmem;
+
+int sim_nanosleep(struct Shmem*, long);
+void sim_failed(struct Shmem*);
+int sim_seq(struct Shmem*);
+void sim_wait(struct Shmem*, int);
+void sim_fire(struct Shmem*, int);
+
+#endif
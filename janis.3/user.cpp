@@ -9,7 +9,9 @@
         This program is to represent a user (child) process which are to be launched from OSS.
         Once this program is running, it receives a message from OSS, telling it to enter the
         critical region. Inside this region, a "time to terminate" is calculated and this child
-        process will execute until the clock in shared memory has surpassed the "time to termiante."
+        process sleeps with sim_nanosleep() until OSS has moved the clock in shared memory up to
+        the "time to termiante" and wakes it. Messages to a USER have its PID as their mtype, so
+        it only ever receives its own.
 
         Once this child has surpassed the "time to terminate" it will look at the PID of the running
         child process and store that in shared memory and then send a message to OSS telling OSS that
@@ -101,8 +103,8 @@ int main(int argc, char *argv[]) {
     ///////////////////////////// 
     
     
-    // USER receiving PID from OSS (buf1.mflag)
-    if (msgrcv(mqid_send, &buf1, sizeof(buf1), 0, 0) == -1) {
+    // USER receiving its start message from OSS (buf1.seed)
+    if (msgrcv(mqid_send, &buf1, MSG_SIZE, getpid(), 0) == -1) {
         error_msg = "user: msgrcv: Error: Message was not received";
         perror(error_msg.c_str());
         exit(EXIT_FAILURE);
@@ -112,34 +114,16 @@ int main(int argc, char *argv[]) {
 
 
     // TIME TO TERMINATE IS DETERMINED BELOW
-    srand(getpid()+buf1.mflag); // Seeds a random number generator
-    int current_sec = shmem->sec; // Stores the current seconds
-    int current_nanosec = shmem->nanosec; // Stores the current nanoseconds
-    int random = (rand() % 50000000) + 1/*+ 1*/; // Sets random to a random integer 1-1000000 nanoseconds (1ns - 1ms)
-    current_nanosec += random; // ADDS THE RANDOM AMOUNT OF NANOSECONDS - this guarantess the time it *should* terminate
-    if (current_nanosec >= 1000000000) { // Convert nanoseconds to seconds if possible
-        current_nanosec -= 1000000000;
-        current_sec += 1;
-    }
+    srand(getpid()+buf1.seed); // Seeds a random number generator
+    int random = (rand() % 50000000) + 1/*+ 1*/; // Sets random to a random integer 1-50000000 nanoseconds (1ns - 50ms)
 
-    // BASICALLY, if the shared clock goes over my calculated "time to terminate", then look at the PID
-    while (!(shmem->sec > current_sec) && !((shmem->sec == current_sec) && (shmem->nanosec > current_nanosec))) {
-        // Send a message that we are still waiting
-        buf2.mflag = 2;
-        if (msgsnd(mqid_rec, &buf2, sizeof(buf2), IPC_NOWAIT) == -1) {
-            error_msg = "user: msgsnd: Error: Message was not sent";
-            perror(error_msg.c_str());
-            exit(EXIT_FAILURE); 
-        }
-        // Checked time and it is not time to terminate yet
-        // Waiting for master to say its my turn again
-        if (msgrcv(mqid_send, &buf1, sizeof(buf1), 0, 0) == -1) {
-            error_msg = "user: msgrcv: Error: Message was not received";
-            perror(error_msg.c_str());
-            exit(EXIT_FAILURE);
-        }
+    // BASICALLY, sleep (without using any CPU, or sending any messages) until OSS has moved the
+    // shared clock "random" nanoseconds past where it is now, this guarantees the time it *should* terminate
+    if (sim_nanosleep(shmem, random) == -1) {
+        error_msg = "user: sim_nanosleep: Error: No free timer slot";
+        perror(error_msg.c_str());
+        exit(EXIT_FAILURE);
     }
-     
 
     while (shmem->shmPID != 0) {} // waits for a different child to say its done OR parent response
     // this loops until NO children are in the critical section, opens it up for a new child below
@@ -147,8 +131,10 @@ int main(int argc, char *argv[]) {
     shmem->shmPID = getpid(); // Grabs the PID of the child that is now to terminate
     
     // ONCE THE MESSAGE BELOW IS RECEIVED IN OSS, WE ARE EXITING THE CRITICAL SECTION
-    buf2.mflag = 3; // message to be sent from USER to OSS (LEAVING CRITICAL SECTION)
-    if (msgsnd(mqid_rec, &buf2, sizeof(buf2), IPC_NOWAIT) < 0) { // Sends message on buf2 from USER to OSS
+    buf2.mtype = OSS_MTYPE;
+    buf2.mflag = MSG_LEAVING; // message to be sent from USER to OSS (LEAVING CRITICAL SECTION)
+    buf2.pid = getpid();
+    if (msgsnd(mqid_rec, &buf2, MSG_SIZE, 0) < 0) { // Sends message on buf2 from USER to OSS
         error_msg = "user: msgsnd: Error: Message was not sent";
         perror(error_msg.c_str());
         exit(EXIT_FAILURE);